@@ -17,3 +17,5 @@ class TwitterSentiment(ConanFile):
         self.requires("jsonformoderncpp/3.6.1@vthiery/stable")
         self.requires("range-v3/0.5.0@ericniebler/stable")
         self.requires("libpqxx/6.4.4@bincrafters/stable")
+        self.requires("benchmark/1.5.0")
+        self.requires("zlib/1.2.11")
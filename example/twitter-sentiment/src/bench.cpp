@@ -0,0 +1,391 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fasttext/compact.h>
+#include <fasttext/kernels.h>
+#include <fasttext/predictor.h>
+#include <fasttext/matrix.h>
+#include <range/v3/all.hpp>
+
+#include "twitter.h"
+#include "utils.h"
+#include "db/columnar.h"
+#include "db/tweet.h"
+
+
+namespace {
+
+    // Tweets checked in the repository, one JSON per line (as they come from the stream API)
+    const std::vector<std::string>& corpus() {
+        static const std::vector<std::string> lines = [](){
+            std::vector<std::string> ret;
+            std::ifstream is(TWEETS_CORPUS);
+            for (std::string line; std::getline(is, line);) {
+                if (!line.empty()) ret.push_back(line);
+            }
+            if (ret.empty()) throw std::runtime_error("Cannot read tweets from '" TWEETS_CORPUS "'");
+            return ret;
+        }();
+        return lines;
+    }
+
+    const std::vector<nlohmann::json>& corpus_json() {
+        static const std::vector<nlohmann::json> tweets = [](){
+            std::vector<nlohmann::json> ret;
+            for (auto& line: corpus()) ret.push_back(nlohmann::json::parse(line));
+            return ret;
+        }();
+        return tweets;
+    }
+
+    const std::vector<std::string>& corpus_texts() {
+        static const std::vector<std::string> texts = [](){
+            std::vector<std::string> ret;
+            for (auto& tweet: corpus_json()) ret.push_back(twitter::tweettext(tweet));
+            return ret;
+        }();
+        return texts;
+    }
+
+    // Model for the fastText benchmarks: the one in 'FASTTEXT_MODEL' or a small one trained with the
+    //  corpus (labels are meaningless, but words and character n-grams are the ones in the tweets)
+    const std::string& corpus_model() {
+        static const std::string path = [](){
+            if (const char* model = std::getenv("FASTTEXT_MODEL")) return std::string{model};
+            const std::string output = "bench_model";
+            {
+                std::ofstream os(output + ".txt");
+                std::size_t i = 0;
+                for (auto& text: corpus_texts()) {
+                    os << "__label__" << (i++ % 3) << " " << utils::tolower(text) << "\n";
+                }
+            }
+            fasttext::Args args;
+            args.input = output + ".txt";
+            args.output = output;
+            args.model = fasttext::model_name::sup;
+            args.loss = fasttext::loss_name::softmax;
+            args.dim = 100;
+            args.epoch = 1;
+            args.minCount = 1;
+            args.minn = 2;
+            args.maxn = 5;
+            args.wordNgrams = 2;
+            args.thread = 1;
+            args.verbose = 0;
+            fasttext::FastText fasttext;
+            fasttext.train(args);
+            fasttext.saveModel();
+            return output + ".bin";
+        }();
+        return path;
+    }
+
+    // Rows as the pipeline stores them
+    const std::vector<db::Tweet>& corpus_db_tweets() {
+        static const std::vector<db::Tweet> tweets = [](){
+            std::vector<db::Tweet> ret;
+            for (auto& tweet: corpus_json()) {
+                if (!tweet.count("timestamp_ms") || !tweet.count("id_str")) continue;
+                twitter::Tweet tw{tweet};
+                const std::vector<std::string>& hashtags{tw.hashtags()};
+                std::string hashtags_as_str{(hashtags | ranges::view::join(',') | ranges::to_<std::string>())};
+                ret.emplace_back(tw.timestamp(), tw.id_str(), tw.lang(), tw.user_id(), hashtags_as_str, tw.text(), "positive", 0.75f);
+            }
+            return ret;
+        }();
+        return tweets;
+    }
+
+    // The stream as we receive it from curl: lines ending with '\r\n' in chunks that don't respect line boundaries
+    std::vector<std::string> corpus_chunks(std::size_t chunk_size) {
+        std::string stream;
+        for (auto& line: corpus()) stream += line + "\r\n";
+        std::vector<std::string> chunks;
+        for (std::size_t i = 0; i < stream.size(); i += chunk_size) {
+            chunks.push_back(stream.substr(i, chunk_size));
+        }
+        return chunks;
+    }
+}
+
+
+static void BM_split(benchmark::State& state) {
+    const auto chunks = corpus_chunks(state.range(0));
+    for (auto _ : state) {
+        for (auto& chunk: chunks) {
+            benchmark::DoNotOptimize(utils::split(chunk, "\r\n"));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * chunks.size());
+}
+BENCHMARK(BM_split)->Arg(512)->Arg(4096);
+
+static void BM_tolower(benchmark::State& state) {
+    auto& texts = corpus_texts();
+    for (auto _ : state) {
+        for (auto& text: texts) {
+            benchmark::DoNotOptimize(utils::tolower(text));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * texts.size());
+}
+BENCHMARK(BM_tolower);
+
+static void BM_splitwords(benchmark::State& state) {
+    auto& texts = corpus_texts();
+    for (auto _ : state) {
+        for (auto& text: texts) {
+            benchmark::DoNotOptimize(utils::splitwords(text));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * texts.size());
+}
+BENCHMARK(BM_splitwords);
+
+static void BM_tweettext(benchmark::State& state) {
+    auto& tweets = corpus_json();
+    for (auto _ : state) {
+        for (auto& tweet: tweets) {
+            benchmark::DoNotOptimize(twitter::tweettext(tweet));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * tweets.size());
+}
+BENCHMARK(BM_tweettext);
+
+static void BM_Tweet_construction(benchmark::State& state) {
+    auto& tweets = corpus_json();
+    for (auto _ : state) {
+        for (auto& tweet: tweets) {
+            benchmark::DoNotOptimize(twitter::Tweet(tweet));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * tweets.size());
+}
+BENCHMARK(BM_Tweet_construction);
+
+static void BM_Tweet_accessors(benchmark::State& state) {
+    std::vector<twitter::Tweet> tweets;
+    for (auto& tweet: corpus_json()) {
+        if (tweet.count("timestamp_ms") && tweet.count("id_str")) tweets.emplace_back(tweet);
+    }
+    for (auto _ : state) {
+        for (auto& tw: tweets) {
+            benchmark::DoNotOptimize(tw.id_str());
+            benchmark::DoNotOptimize(tw.user_id());
+            benchmark::DoNotOptimize(tw.lang());
+            benchmark::DoNotOptimize(tw.text());
+            benchmark::DoNotOptimize(tw.timestamp());
+            benchmark::DoNotOptimize(tw.hashtags());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * tweets.size());
+}
+BENCHMARK(BM_Tweet_accessors);
+
+static void BM_parsetweets(benchmark::State& state) {
+    const auto chunks = corpus_chunks(state.range(0));
+    auto tweetthread = rxcpp::observe_on_new_thread();
+    pipeline::queue_options<std::string> lines;
+    int count = 0;
+    for (auto _ : state) {
+        count = rxcpp::observable<>::iterate(chunks) |
+                twitter::parsetweets(lines, tweetthread) |
+                rxcpp::rxo::map([](twitter::parsedtweets p){ return p.tweets; }) |
+                rxcpp::operators::merge(tweetthread) |
+                rxcpp::operators::count() |
+                rxcpp::operators::as_blocking() |
+                rxcpp::operators::first();
+    }
+    state.counters["tweets"] = count;
+    state.SetItemsProcessed(state.iterations() * count);
+    state.SetBytesProcessed(state.iterations() * state.range(0) * chunks.size());
+}
+BENCHMARK(BM_parsetweets)->Arg(4096)->UseRealTime();
+
+static void BM_insert_query(benchmark::State& state) {
+    auto& db_tweets = corpus_db_tweets();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db::TweetManager::insert_query(db_tweets));
+    }
+    state.SetItemsProcessed(state.iterations() * db_tweets.size());
+}
+BENCHMARK(BM_insert_query);
+
+// Columnar file: a batch encoded and appended as a chunk
+static void BM_columnar_insert(benchmark::State& state) {
+    auto& db_tweets = corpus_db_tweets();
+    std::remove("bench.columnar");
+    db::ColumnarWriter writer("bench.columnar");
+    for (auto _ : state) {
+        writer.insert(db_tweets);
+    }
+    state.SetItemsProcessed(state.iterations() * db_tweets.size());
+    std::remove("bench.columnar");
+}
+BENCHMARK(BM_columnar_insert);
+
+// Columnar file with a hundred copies of the corpus, an hour apart, read for the given per cent of that time
+static void BM_columnar_filter(benchmark::State& state) {
+    constexpr int copies = 100;
+    constexpr time_t hour = 3600 * 1000;
+    std::remove("bench.columnar");
+    std::vector<db::Tweet> batch = corpus_db_tweets();
+    time_t first = std::get<0>(batch.front());
+    for (auto& tweet: batch) first = std::min(first, std::get<0>(tweet));
+    {
+        db::ColumnarWriter writer("bench.columnar");
+        for (int i = 0; i < copies; ++i) {
+            writer.insert(batch);
+            for (auto& tweet: batch) std::get<0>(tweet) += hour;
+        }
+    }
+    db::ColumnarReader reader("bench.columnar");
+    const time_t end = first + copies * hour * state.range(0) / 100;
+    std::size_t count = 0;
+    for (auto _ : state) {
+        count = reader.filter(first, end).size();
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    std::remove("bench.columnar");
+}
+BENCHMARK(BM_columnar_filter)->Arg(1)->Arg(10)->Arg(100);
+
+// Inference kernels on a synthetic model: 'Dim' selects the specialized kernel, the
+//  generic one runs with the same dimension for comparison
+static const std::int32_t kernel_words = 100000;
+static const std::int32_t kernel_labels = 3;
+
+template <int Dim>
+static void BM_kernels_average(benchmark::State& state) {
+    const int64_t dim = state.range(0);
+    fasttext::Matrix input(kernel_words, dim);
+    input.uniform(1.0 / dim);
+    std::vector<std::int32_t> ids;
+    for (std::int32_t i = 0; i < 40; ++i) ids.push_back((i * 104729) % kernel_words);
+    std::vector<fasttext::real> hidden(dim);
+    for (auto _ : state) {
+        fasttext::kernels::Kernel<Dim>::average(&input.at(0, 0), dim, ids.data(), ids.size(), hidden.data());
+        benchmark::DoNotOptimize(hidden.data());
+    }
+    state.SetItemsProcessed(state.iterations() * ids.size());
+}
+BENCHMARK_TEMPLATE(BM_kernels_average, 0)->Arg(10)->Arg(100)->Arg(300);
+BENCHMARK_TEMPLATE(BM_kernels_average, 10)->Arg(10);
+BENCHMARK_TEMPLATE(BM_kernels_average, 100)->Arg(100);
+BENCHMARK_TEMPLATE(BM_kernels_average, 300)->Arg(300);
+
+template <int Dim>
+static void BM_kernels_scores(benchmark::State& state) {
+    const int64_t dim = state.range(0);
+    const int64_t rows = state.range(1);
+    fasttext::Matrix output(rows, dim);
+    output.uniform(1.0 / dim);
+    std::vector<fasttext::real> hidden(dim, 0.5), scores(rows);
+    for (auto _ : state) {
+        fasttext::kernels::Kernel<Dim>::scores(&output.at(0, 0), dim, rows, hidden.data(), scores.data());
+        fasttext::kernels::softmax(scores.data(), rows);
+        benchmark::DoNotOptimize(scores.data());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK_TEMPLATE(BM_kernels_scores, 0)->Args({10, kernel_labels})->Args({100, kernel_labels})->Args({300, kernel_labels})
+                                         ->Args({10, 1000})->Args({100, 1000})->Args({300, 1000});
+BENCHMARK_TEMPLATE(BM_kernels_scores, 10)->Args({10, kernel_labels})->Args({10, 1000});
+BENCHMARK_TEMPLATE(BM_kernels_scores, 100)->Args({100, kernel_labels})->Args({100, 1000});
+BENCHMARK_TEMPLATE(BM_kernels_scores, 300)->Args({300, kernel_labels})->Args({300, 1000});
+
+// Same scoring with the matrix stored as float32, float16 or int8 (argument is the storage)
+static void BM_compact_scores(benchmark::State& state) {
+    const auto storage = static_cast<fasttext::storage>(state.range(0));
+    const int64_t dim = state.range(1);
+    const int64_t rows = 1000;
+    fasttext::Matrix output(rows, dim);
+    output.uniform(1.0 / dim);
+    std::unique_ptr<fasttext::CompactMatrix> compact;
+    if (storage != fasttext::storage::f32) compact.reset(new fasttext::CompactMatrix(output, storage));
+    const auto kernels = fasttext::kernels::select(dim);
+    std::vector<fasttext::real> hidden(dim, 0.5), scores(rows);
+    for (auto _ : state) {
+        if (compact) compact->scores(hidden.data(), scores.data());
+        else kernels.scores(&output.at(0, 0), dim, rows, hidden.data(), scores.data());
+        benchmark::DoNotOptimize(scores.data());
+    }
+    state.SetLabel(fasttext::storageName(storage));
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.SetBytesProcessed(state.iterations() * (compact ? compact->memory() : rows * dim * sizeof(fasttext::real)));
+}
+BENCHMARK(BM_compact_scores)->Args({0, 100})->Args({1, 100})->Args({2, 100})->Args({0, 300})->Args({1, 300})->Args({2, 300});
+
+// Tokenization into fastText input ids (argument is the capacity of the subword cache, 0 is the
+//  upstream path), tweets repeat their misspellings and hashtags so most of the tokens are hits
+static void BM_getLine(benchmark::State& state) {
+    fasttext::Predictor predictor;
+    predictor.setSubwordCache(state.range(0));
+    predictor.loadModel(corpus_model());
+    std::vector<std::string> texts;
+    for (auto& text: corpus_texts()) texts.push_back(utils::tolower(text));
+    std::vector<std::int32_t> words, labels;
+    for (auto _ : state) {
+        for (auto& text: texts) {
+            std::istringstream is(text);
+            if (state.range(0)) predictor.getLine(is, words, labels);
+            else predictor.getDictionary()->getLine(is, words, labels);
+            benchmark::DoNotOptimize(words.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * texts.size());
+    if (auto cache = predictor.getSubwordCache()) {
+        state.counters["hit_rate"] = cache->hitRate();
+    }
+}
+BENCHMARK(BM_getLine)->Arg(0)->Arg(1000)->Arg(100000);
+
+// Same tokenization without streams: from the text in memory and from the words already split
+//  (argument is the capacity of the subword cache)
+static void BM_getLine_memory(benchmark::State& state) {
+    fasttext::Predictor predictor;
+    predictor.setSubwordCache(state.range(0));
+    predictor.loadModel(corpus_model());
+    std::vector<std::string> texts;
+    for (auto& text: corpus_texts()) texts.push_back(utils::tolower(text));
+    std::vector<std::int32_t> words, labels;
+    for (auto _ : state) {
+        for (auto& text: texts) {
+            predictor.getLine(std::string_view{text}, words, labels);
+            benchmark::DoNotOptimize(words.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * texts.size());
+}
+BENCHMARK(BM_getLine_memory)->Arg(0)->Arg(100000);
+
+static void BM_getTokens(benchmark::State& state) {
+    fasttext::Predictor predictor;
+    predictor.setSubwordCache(state.range(0));
+    predictor.loadModel(corpus_model());
+    std::vector<std::vector<std::string>> tokens;
+    for (auto& text: corpus_texts()) tokens.push_back(utils::splitwords(utils::tolower(text)));
+    std::vector<std::int32_t> words, labels;
+    for (auto _ : state) {
+        for (auto& line: tokens) {
+            predictor.getTokens(line.begin(), line.end(), words, labels);
+            benchmark::DoNotOptimize(words.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+BENCHMARK(BM_getTokens)->Arg(0)->Arg(100000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,384 @@
+
+#include "classifier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <sys/stat.h>
+#include <fmt/format.h>
+
+#include "memo.h"
+#include "metrics.h"
+
+namespace classifier {
+
+    namespace {
+        const std::string label_prefix = "__label__";
+        std::atomic<std::uint64_t> generations{0};
+
+        std::size_t file_size(const std::string& path) {
+            std::ifstream is(path, std::ios::binary | std::ios::ate);
+            if (!is) {
+                throw std::runtime_error(fmt::format("Cannot open model '{}'", path));
+            }
+            return static_cast<std::size_t>(is.tellg());
+        }
+
+        std::time_t modification_time(const std::string& path) {
+            struct stat st{};
+            if (::stat(path.c_str(), &st) != 0) return 0;
+            return st.st_mtime;
+        }
+    }
+
+    std::string fasttext_line(std::string_view text) {
+        std::string line{text};
+        std::replace(line.begin(), line.end(), '\n', ' ');
+        line.push_back('\n');
+        return line;
+    }
+
+    Model::Model(const std::string& path, fasttext::storage storage, std::size_t subwords) : _generation(++generations), _path(path), _memory(file_size(path)), _modified(modification_time(path)) {
+        _fasttext.setSubwordCache(subwords);
+        _fasttext.loadModel(path);
+        if (subwords > 0 && !_fasttext.isPruned()) {
+            _tokens = std::make_unique<utils::LruCache<words::word_id, std::shared_ptr<const fasttext::Subwords>>>(subwords);
+        }
+        if (_fasttext.getArgs().model != fasttext::model_name::sup || _fasttext.getDictionary()->nlabels() == 0) {
+            throw std::runtime_error(fmt::format("Model '{}' is not a supervised model", path));
+        }
+        if (storage != fasttext::storage::f32) {
+            const std::size_t dense = _fasttext.memory();
+            _fasttext.compact(storage);
+            _memory = _memory - std::min(_memory, dense) + _fasttext.memory();
+        }
+    }
+
+    Prediction Model::predict(std::string_view text) const {
+        std::vector<std::pair<fasttext::real, std::int32_t>> predictions;
+        _fasttext.predictLine(fasttext_line(text), 1, predictions);
+        return prediction(predictions);
+    }
+
+    Prediction Model::predict(const twitter::Tweet& tweet) const {
+        const auto& tokens = tweet.data->tokens;
+        // words past the capacity of the interner can't be resolved, pruned models need the text
+        if (!_tokens || std::any_of(tokens.begin(), tokens.end(), [](words::word_id id) { return id >= words::Interner::overflow; })) {
+            return predict(tweet.text());
+        }
+
+        auto& interner = words::Interner::instance();
+        std::vector<std::int32_t> ids, labels, hashes;
+        std::shared_ptr<const fasttext::Subwords> subwords;
+        for (auto id: tokens) {
+            if (_tokens->get(id, subwords)) {
+                ++_token_hits;
+            } else {
+                subwords = _fasttext.getSubwords(std::string(interner.word(id)));
+                _tokens->put(id, subwords);
+            }
+            _fasttext.addSubwords(*subwords, ids, labels, hashes);
+        }
+        _fasttext.addWordNgrams(ids, hashes);
+
+        std::vector<std::pair<fasttext::real, std::int32_t>> predictions;
+        _fasttext.predict(1, ids, predictions);
+        return prediction(predictions);
+    }
+
+    Prediction Model::prediction(const std::vector<std::pair<fasttext::real, std::int32_t>>& predictions) const {
+        if (predictions.empty()) return {};
+
+        Prediction ret{_fasttext.getDictionary()->getLabel(predictions[0].second), predictions[0].first};
+        if (ret.label.compare(0, label_prefix.size(), label_prefix) == 0) {
+            ret.label.erase(0, label_prefix.size());
+        }
+        return ret;
+    }
+
+    void Model::warmup() const {
+        auto dict = _fasttext.getDictionary();
+        std::string line;
+        for (std::int32_t i = 0; i < std::min<std::int32_t>(dict->nwords(), 100); ++i) {
+            line += dict->getWord(i) + " ";
+        }
+        predict(line);
+    }
+
+    const std::string& Model::path() const {
+        return _path;
+    }
+
+    std::size_t Model::memory() const {
+        return _memory;
+    }
+
+    std::time_t Model::modified() const {
+        return _modified;
+    }
+
+    std::uint64_t Model::generation() const {
+        return _generation;
+    }
+
+    std::uint64_t Model::subword_hits() const {
+        auto cache = _fasttext.getSubwordCache();
+        return _token_hits + (cache ? cache->hits() : 0);
+    }
+
+    std::uint64_t Model::subword_misses() const {
+        auto cache = _fasttext.getSubwordCache();
+        return cache ? cache->misses() : 0;
+    }
+
+
+    namespace {
+        const char* const cache_gauges[] = {"classifier_cache_memory_bytes", "classifier_retired_memory_bytes", "classifier_subword_cache_hits", "classifier_subword_cache_misses"};
+    }
+
+    ModelCache::ModelCache(cache_options options)
+            : _options(std::move(options))
+            , _evictions(metrics::Registry::instance().counter("classifier_cache_evictions_total", "Models evicted from the cache"))
+    {
+        metrics::Registry::instance().gauge("classifier_cache_memory_bytes", "Memory used by the models in the cache", [this](){ return memory(); });
+        metrics::Registry::instance().gauge("classifier_retired_memory_bytes", "Memory used by replaced models still in use", [this](){ return retired_memory(); });
+        metrics::Registry::instance().gauge("classifier_subword_cache_hits", "Tokens found in the subword caches of the loaded models", [this](){ return subword_stats().first; });
+        metrics::Registry::instance().gauge("classifier_subword_cache_misses", "Tokens not found in the subword caches of the loaded models", [this](){ return subword_stats().second; });
+    }
+
+    ModelCache::~ModelCache() {
+        for (auto name: cache_gauges) {
+            metrics::Registry::instance().remove(name);
+        }
+        std::map<std::string, std::future<void>> reloads;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            reloads.swap(_reloads);
+        }
+        for (auto& it: reloads) {
+            it.second.wait();
+        }
+    }
+
+    std::shared_ptr<const Model> ModelCache::get(const std::string& lang) {
+        static auto& hits = metrics::Registry::instance().counter("classifier_cache_hits_total", "Models found in the cache");
+        static auto& misses = metrics::Registry::instance().counter("classifier_cache_misses_total", "Models not found in the cache");
+
+        model_future model;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _models.find(lang);
+            if (it != _models.end()) {
+                hits.add();
+                _lru.splice(_lru.begin(), _lru, it->second.lru);
+                model = it->second.model;
+            }
+        }
+        if (model.valid()) {
+            return model.get();  // it may still be loading in another thread
+        }
+
+        misses.add();
+        return load(lang);
+    }
+
+    void ModelCache::reload(const std::string& lang) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _reloads.find(lang);
+        if (it != _reloads.end() && it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;  // already reloading
+        }
+
+        const auto requested = std::chrono::steady_clock::now();
+        _reloads[lang] = std::async(std::launch::async, [this, lang, requested]() {
+            static auto& failures = metrics::Registry::instance().counter("classifier_reload_failures_total", "Models that couldn't be reloaded");
+            try {
+                auto model = std::make_shared<const Model>(fmt::format(_options.path_pattern, lang), _options.storage, _options.subword_cache);
+                model->warmup();
+                swap(lang, std::move(model), requested);
+            } catch (const std::exception& e) {
+                std::cerr << "cannot reload model for language '" << lang << "', keep the old one: " << e.what() << std::endl;
+                failures.add();
+            }
+        });
+    }
+
+    void ModelCache::check(bool force) {
+        std::vector<std::string> changed;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& it: _models) {
+                if (it.second.model.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+                if (auto model = it.second.model.get()) {
+                    if (force || modification_time(model->path()) != model->modified()) {
+                        changed.push_back(it.first);
+                    }
+                } else {
+                    // no model for the language (yet), try again when its file shows up or changes
+                    const std::time_t modified = modification_time(fmt::format(_options.path_pattern, it.first));
+                    if (force || modified != it.second.modified) {
+                        it.second.modified = modified;
+                        changed.push_back(it.first);
+                    }
+                }
+            }
+        }
+        for (auto& lang: changed) {
+            reload(lang);
+        }
+    }
+
+    std::size_t ModelCache::memory() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _memory;
+    }
+
+    std::size_t ModelCache::retired_memory() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::size_t ret = 0;
+        for (auto& it: _retired) {
+            if (auto model = it.lock()) ret += model->memory();
+        }
+        return ret;
+    }
+
+    std::pair<std::uint64_t, std::uint64_t> ModelCache::subword_stats() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::pair<std::uint64_t, std::uint64_t> ret{0, 0};
+        for (auto& it: _models) {
+            if (it.second.memory == 0 || it.second.model.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+            if (auto model = it.second.model.get()) {
+                ret.first += model->subword_hits();
+                ret.second += model->subword_misses();
+            }
+        }
+        return ret;
+    }
+
+    void ModelCache::swap(const std::string& lang, std::shared_ptr<const Model> model, std::chrono::steady_clock::time_point requested) {
+        static auto& swaps = metrics::Registry::instance().counter("classifier_swaps_total", "Models replaced while running");
+        static auto& latency = metrics::Registry::instance().histogram("classifier_swap_seconds", "Time since a reload is requested until the new model is used");
+
+        std::promise<std::shared_ptr<const Model>> ready;
+        ready.set_value(model);
+
+        std::shared_ptr<const Model> old;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _models.find(lang);
+            if (it == _models.end()) return;  // evicted meanwhile, it will be loaded again if needed
+            // still being loaded (from the new file too), waiting here would block every other language
+            if (it->second.model.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+            old = it->second.model.get();
+            it->second.model = ready.get_future().share();
+            _memory += model->memory() - (old ? old->memory() : 0);
+            it->second.memory = model->memory();
+
+            _retired.erase(std::remove_if(_retired.begin(), _retired.end(), [](const std::weak_ptr<const Model>& m){ return m.expired(); }), _retired.end());
+            if (old) _retired.push_back(old);
+            evict(lang);
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - requested;
+        latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        swaps.add();
+        // while batches in flight finish with it, both models are in memory
+        const std::size_t overlap = (old && old.use_count() > 1) ? old->memory() : 0;
+        std::cerr << "model for language '" << lang << "' swapped in " << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+                  << " ms (" << overlap / (1024 * 1024) << " MB still used by the old one)" << std::endl;
+    }
+
+    std::shared_ptr<const Model> ModelCache::load(const std::string& lang) {
+        static auto& loads = metrics::Registry::instance().counter("classifier_cache_loads_total", "Models loaded into the cache");
+        static auto& failures = metrics::Registry::instance().counter("classifier_cache_load_failures_total", "Languages without a model");
+        static auto& latency = metrics::Registry::instance().histogram("classifier_cache_load_seconds", "Time to load a model");
+
+        std::promise<std::shared_ptr<const Model>> promise;
+        model_future loading;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _models.find(lang);
+            if (it != _models.end()) {
+                loading = it->second.model;  // another thread started loading it
+            } else {
+                _lru.push_front(lang);
+                _models[lang] = Entry{promise.get_future().share(), 0, _lru.begin()};
+            }
+        }
+        if (loading.valid()) {
+            return loading.get();
+        }
+
+        // Load outside the lock, other languages can be used (or loaded) meanwhile
+        const std::string path = fmt::format(_options.path_pattern, lang);
+        std::shared_ptr<const Model> model;
+        try {
+            metrics::Timer timer{latency};
+            model = std::make_shared<const Model>(path, _options.storage, _options.subword_cache);
+            loads.add();
+        } catch (const std::exception& e) {
+            // remember there is no model, so we don't try again for every tweet
+            std::cerr << "no model for language '" << lang << "': " << e.what() << std::endl;
+            failures.add();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _models.find(lang);
+            if (model && it != _models.end()) {
+                it->second.memory = model->memory();
+                _memory += model->memory();
+                evict(lang);
+            } else if (it != _models.end()) {
+                it->second.modified = modification_time(path);  // 'check' tries again if it changes
+            }
+        }
+        promise.set_value(model);
+        return model;
+    }
+
+    void ModelCache::evict(const std::string& keep) {
+        // least recently used first, models being used by other threads are released when they finish
+        for (auto it = _lru.rbegin(); it != _lru.rend() && _memory > _options.memory_budget;) {
+            const std::string& lang = *it;
+            auto model = _models.find(lang);
+            if (lang == keep || _options.pinned.count(lang) || model->second.memory == 0) {
+                ++it;
+                continue;
+            }
+            std::cerr << "evict model for language '" << lang << "'" << std::endl;
+            _memory -= model->second.memory;
+            _models.erase(model);
+            it = std::list<std::string>::reverse_iterator(_lru.erase(std::next(it).base()));
+            _evictions.add();
+        }
+    }
+
+
+    std::vector<Prediction> classify(ModelCache& cache, const std::vector<twitter::Tweet>& tweets, Memo* memo) {
+        static auto& latency = metrics::Registry::instance().histogram("classifier_batch_seconds", "Time to classify a batch of tweets");
+        static auto& classified = metrics::Registry::instance().counter("classifier_tweets_total", "Tweets classified");
+        metrics::Timer timer{latency};
+
+        std::map<std::string, std::vector<std::size_t>> by_lang;
+        for (std::size_t i = 0; i < tweets.size(); ++i) {
+            by_lang[tweets[i].lang()].push_back(i);
+        }
+
+        std::vector<Prediction> predictions(tweets.size());
+        for (auto& it: by_lang) {
+            auto model = cache.get(it.first);
+            if (!model) continue;
+            for (auto i: it.second) {
+                if (memo && memo->find(*model, tweets[i], predictions[i])) continue;
+                predictions[i] = model->predict(tweets[i]);
+                if (memo) memo->insert(*model, tweets[i], predictions[i]);
+            }
+            classified.add(it.second.size());
+        }
+        return predictions;
+    }
+}
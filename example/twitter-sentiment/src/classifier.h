@@ -0,0 +1,148 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fasttext/predictor.h>
+
+#include "lru.h"
+#include "metrics.h"
+#include "tweet.h"
+#include "words.h"
+
+
+namespace classifier {
+
+    struct Prediction
+    {
+        std::string label;  // without the '__label__' prefix, empty if the tweet couldn't be classified
+        float probability = 0.f;
+    };
+
+    // The text as 'fasttext predict' reads it: one line (new lines are replaced with spaces) ending in
+    //  a new line, so the model sees the same tokens (and word n-grams) it was trained with
+    std::string fasttext_line(std::string_view text);
+
+    class Model {
+    public:
+        // 'subwords' is the capacity of the subword cache of the model (0 disables it). Only supervised
+        //  models can classify tweets, it throws for any other one (like the unsupervised cc.*.bin vectors).
+        explicit Model(const std::string& path, fasttext::storage storage = fasttext::storage::f32, std::size_t subwords = 0);
+
+        // Classifies the raw text of the tweet (all the tokens, in order)
+        Prediction predict(std::string_view text) const;
+        // Same prediction from the interned tokens of the tweet ('Tweet::shared::tokens'): each token is
+        //  mapped to its fastText ids once per model, then the tweet is never split nor hashed again
+        Prediction predict(const twitter::Tweet& tweet) const;
+        // Classifies a line with the first words of the dictionary, so the pages of the matrices and
+        //  the caches are ready before the model gets any traffic
+        void warmup() const;
+
+        const std::string& path() const;
+        // Memory used by the model (the size of the file, minus what compacting the matrices saves)
+        std::size_t memory() const;
+        // Modification time of the file when the model was loaded
+        std::time_t modified() const;
+        // Unique number for every model loaded
+        std::uint64_t generation() const;
+        // Tokens found (and not found) in the subword caches (by interned id, then by text)
+        std::uint64_t subword_hits() const;
+        std::uint64_t subword_misses() const;
+
+    protected:
+        const std::uint64_t _generation;
+        const std::string _path;
+        std::size_t _memory;
+        std::time_t _modified;
+        fasttext::Predictor _fasttext;
+        // fastText ids of the interned tokens seen, nullptr if the subword cache is disabled
+        std::unique_ptr<utils::LruCache<words::word_id, std::shared_ptr<const fasttext::Subwords>>> _tokens;
+        mutable std::atomic<std::uint64_t> _token_hits{0};
+
+        Prediction prediction(const std::vector<std::pair<fasttext::real, std::int32_t>>& predictions) const;
+    };
+
+    struct cache_options
+    {
+        // Path to the supervised model for each language, '{0}' is replaced with the language code
+        std::string path_pattern = "sentiment.{0}.bin";
+        std::size_t memory_budget = std::size_t(8) * 1024 * 1024 * 1024;
+        // These languages are never evicted from the cache
+        std::set<std::string> pinned;
+        // Keep the matrices as float16 or int8 to fit more languages in the budget
+        fasttext::storage storage = fasttext::storage::f32;
+        // Tokens (per model) whose character n-grams are kept, most of them are out of vocabulary
+        std::size_t subword_cache = 100000;
+    };
+
+    // One model per language, loaded the first time it is needed and kept in memory while the
+    //  models together don't exceed the memory budget (least recently used ones are evicted).
+    //
+    //  Models can be replaced without stopping the pipeline: the new model is loaded in a background
+    //  thread and swapped when it is ready, callers that already got the old model (a batch being
+    //  classified) keep using it until they release it.
+    class ModelCache {
+    public:
+        explicit ModelCache(cache_options options);
+        ~ModelCache();
+
+        // Returns nullptr if there is no model for the language
+        std::shared_ptr<const Model> get(const std::string& lang);
+
+        // Loads again the model for the language in the background and swaps it when ready
+        void reload(const std::string& lang);
+        // Reloads the models whose file has changed (or all of them if 'force'), languages without a
+        //  model are tried again if their file shows up
+        void check(bool force = false);
+
+        std::size_t memory() const;
+        // Memory used by replaced models that are still in use
+        std::size_t retired_memory() const;
+        // Hits and misses of the subword caches of the models currently in the cache
+        std::pair<std::uint64_t, std::uint64_t> subword_stats() const;
+
+    protected:
+        typedef std::shared_future<std::shared_ptr<const Model>> model_future;
+        struct Entry {
+            model_future model;
+            std::size_t memory = 0;
+            std::list<std::string>::iterator lru;
+            std::time_t modified = 0;  // of the file when there is no model for the language
+        };
+
+        std::shared_ptr<const Model> load(const std::string& lang);
+        void swap(const std::string& lang, std::shared_ptr<const Model> model, std::chrono::steady_clock::time_point requested);
+        void evict(const std::string& keep);
+
+        const cache_options _options;
+        // looked up before taking '_mutex': registering a metric takes the lock of the registry,
+        //  which is held while the gauges of the cache take '_mutex'
+        metrics::Counter& _evictions;
+        mutable std::mutex _mutex;
+        std::map<std::string, Entry> _models;
+        std::list<std::string> _lru;  // most recently used first
+        std::size_t _memory = 0;
+        std::map<std::string, std::future<void>> _reloads;
+        std::vector<std::weak_ptr<const Model>> _retired;
+    };
+
+    class Memo;
+
+    // Tweets are grouped by language so each model classifies all its tweets in a row, returned
+    //  predictions are in the same order as the tweets. If a 'memo' is given, tweets already seen
+    //  are not classified again.
+    std::vector<Prediction> classify(ModelCache& cache, const std::vector<twitter::Tweet>& tweets, Memo* memo = nullptr);
+}
@@ -0,0 +1,456 @@
+#include "columnar.h"
+
+#include <array>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../metrics.h"
+
+namespace db {
+
+    namespace {
+        const char magic[8] = {'T', 'W', 'C', 'O', 'L', 'v', '1', '\n'};
+        constexpr std::size_t header_size = 4 + 8 + 8 + 4 + 4;
+
+        enum class encoding : std::uint8_t {
+            plain = 0,       // values one after the other (strings prefixed by their length)
+            dictionary = 1,  // distinct values, then the index of the value of each row
+            delta = 2        // difference with the minimum timestamp of the chunk
+        };
+
+        struct chunk_header {
+            chunk_stats stats;
+            std::uint32_t body_size = 0;
+            std::uint32_t crc = 0;
+        };
+
+        // A column in the body of a chunk, as it is stored
+        struct column {
+            encoding type;
+            std::uint32_t size;    // decompressed
+            std::uint32_t stored;
+            const char* data;
+        };
+        constexpr std::size_t columns = std::tuple_size<Tweet>::value;
+
+        typedef std::unique_ptr<std::FILE, int(*)(std::FILE*)> file_ptr;
+
+        std::runtime_error corrupted(const std::string& path) {
+            return std::runtime_error("Corrupted columnar file '" + path + "'");
+        }
+
+        template <class T>
+        void put(std::string& out, T value) {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        template <class T>
+        bool get(const char*& p, const char* end, T& value) {
+            if (static_cast<std::size_t>(end - p) < sizeof(T)) return false;
+            std::memcpy(&value, p, sizeof(T));
+            p += sizeof(T);
+            return true;
+        }
+
+        void put_varint(std::string& out, std::uint64_t value) {
+            for (; value >= 0x80; value >>= 7) {
+                out.push_back(static_cast<char>(value | 0x80));
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        bool get_varint(const char*& p, const char* end, std::uint64_t& value) {
+            value = 0;
+            for (int shift = 0; p != end && shift < 64; shift += 7) {
+                const auto byte = static_cast<unsigned char>(*p++);
+                value |= std::uint64_t{byte & 0x7fu} << shift;
+                if (!(byte & 0x80)) return true;
+            }
+            return false;
+        }
+
+        void put_string(std::string& out, std::string_view value) {
+            put_varint(out, value.size());
+            out.append(value.data(), value.size());
+        }
+
+        bool get_string(const char*& p, const char* end, std::string_view& value) {
+            std::uint64_t size;
+            if (!get_varint(p, end, size) || size > static_cast<std::uint64_t>(end - p)) return false;
+            value = std::string_view(p, size);
+            p += size;
+            return true;
+        }
+
+        template <std::size_t I>
+        encoding encode_strings(const std::vector<Tweet>& data, std::string& raw) {
+            std::unordered_map<std::string_view, std::uint32_t> ids;
+            std::vector<std::string_view> values;
+            for (auto& tweet: data) {
+                if (ids.emplace(std::get<I>(tweet), values.size()).second) values.push_back(std::get<I>(tweet));
+            }
+            if (values.size() * 2 > data.size()) {
+                for (auto& tweet: data) put_string(raw, std::get<I>(tweet));
+                return encoding::plain;
+            }
+            put_varint(raw, values.size());
+            for (auto& value: values) put_string(raw, value);
+            for (auto& tweet: data) put_varint(raw, ids[std::get<I>(tweet)]);
+            return encoding::dictionary;
+        }
+
+        // Compressed only if it saves anything, the sizes are equal for columns stored as they are
+        void append_column(std::string& body, encoding type, const std::string& raw, int level) {
+            uLongf size = compressBound(raw.size());
+            std::string compressed(size, '\0');
+            if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &size, reinterpret_cast<const Bytef*>(raw.data()), raw.size(), level) != Z_OK || size >= raw.size()) {
+                compressed = raw;
+            } else {
+                compressed.resize(size);
+            }
+            put(body, static_cast<std::uint8_t>(type));
+            put(body, static_cast<std::uint32_t>(raw.size()));
+            put(body, static_cast<std::uint32_t>(compressed.size()));
+            body += compressed;
+        }
+
+        // Finds where every column is, nothing is decompressed
+        bool split_columns(const std::string& body, std::array<column, columns>& out) {
+            const char* p = body.data();
+            const char* end = p + body.size();
+            for (auto& it: out) {
+                std::uint8_t encoded;
+                if (!get(p, end, encoded) || !get(p, end, it.size) || !get(p, end, it.stored) || it.stored > static_cast<std::size_t>(end - p)) return false;
+                it.type = static_cast<encoding>(encoded);
+                it.data = p;
+                p += it.stored;
+            }
+            return true;
+        }
+
+        bool read_column(const column& it, std::string& raw) {
+            if (it.stored == it.size) {
+                raw.assign(it.data, it.stored);
+                return true;
+            }
+            raw.resize(it.size);
+            uLongf length = it.size;
+            return uncompress(reinterpret_cast<Bytef*>(&raw[0]), &length, reinterpret_cast<const Bytef*>(it.data), it.stored) == Z_OK && length == it.size;
+        }
+
+        // Whether the value is in the dictionary of a dictionary encoded column
+        bool in_dictionary(const std::string& raw, std::string_view value, bool& found) {
+            const char* p = raw.data();
+            const char* end = p + raw.size();
+            std::uint64_t size;
+            if (!get_varint(p, end, size)) return false;
+            found = false;
+            for (std::uint64_t i = 0; i < size && !found; ++i) {
+                std::string_view it;
+                if (!get_string(p, end, it)) return false;
+                found = it == value;
+            }
+            return true;
+        }
+
+        // Values of the rows in 'selected' (in increasing order), the column has 'rows' values
+        bool decode_strings(const std::string& raw, encoding type, std::uint32_t rows, const std::vector<std::uint32_t>& selected, std::vector<std::string_view>& values) {
+            const char* p = raw.data();
+            const char* end = p + raw.size();
+            values.clear();
+            std::vector<std::string_view> dictionary;
+            if (type == encoding::dictionary) {
+                std::uint64_t size;
+                if (!get_varint(p, end, size) || size > raw.size()) return false;
+                dictionary.resize(size);
+                for (auto& value: dictionary) {
+                    if (!get_string(p, end, value)) return false;
+                }
+            } else if (type != encoding::plain) {
+                return false;
+            }
+            auto next = selected.begin();
+            for (std::uint32_t row = 0; row < rows && next != selected.end(); ++row) {
+                std::string_view value;
+                if (type == encoding::dictionary) {
+                    std::uint64_t id;
+                    if (!get_varint(p, end, id) || id >= dictionary.size()) return false;
+                    value = dictionary[id];
+                } else if (!get_string(p, end, value)) {
+                    return false;
+                }
+                if (row == *next) {
+                    values.push_back(value);
+                    ++next;
+                }
+            }
+            return next == selected.end();
+        }
+
+        bool read_header(std::FILE* file, chunk_header& header) {
+            char buffer[header_size];
+            if (std::fread(buffer, 1, header_size, file) != header_size) return false;
+            const char* p = buffer;
+            std::int64_t min_timestamp = 0, max_timestamp = 0;
+            get(p, buffer + header_size, header.stats.rows);
+            get(p, buffer + header_size, min_timestamp);
+            get(p, buffer + header_size, max_timestamp);
+            get(p, buffer + header_size, header.body_size);
+            get(p, buffer + header_size, header.crc);
+            header.stats.min_timestamp = static_cast<time_t>(min_timestamp);
+            header.stats.max_timestamp = static_cast<time_t>(max_timestamp);
+            return true;
+        }
+
+        file_ptr open(const std::string& path) {
+            file_ptr file{std::fopen(path.c_str(), "rb"), &std::fclose};
+            if (!file) throw std::runtime_error("Cannot open columnar file '" + path + "'");
+            char buffer[sizeof(magic)];
+            if (std::fread(buffer, 1, sizeof(magic), file.get()) != sizeof(magic) || std::memcmp(buffer, magic, sizeof(magic)) != 0) {
+                throw std::runtime_error("Not a columnar file '" + path + "'");
+            }
+            return file;
+        }
+
+        template <std::size_t I>
+        void decode_column(const std::string& path, const column& it, std::uint32_t rows, const std::vector<std::uint32_t>& selected, std::vector<Tweet>& out) {
+            std::string raw;
+            std::vector<std::string_view> values;
+            if (!read_column(it, raw) || !decode_strings(raw, it.type, rows, selected, values)) throw corrupted(path);
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                std::get<I>(out[i]).assign(values[i].data(), values[i].size());
+            }
+        }
+
+        // Tweets of the chunk that match the predicate, the columns in it are checked first (the timestamp,
+        //  then the dictionaries) and the rest are decoded only for the rows left
+        void decode_chunk(const std::string& path, const chunk_header& header, const std::string& body, const predicate& where, std::vector<Tweet>& out) {
+            static auto& pruned = metrics::Registry::instance().counter("columnar_pruned_chunks_total", "Chunks of the columnar file without the values of a scan in their dictionaries");
+            const std::uint32_t rows = header.stats.rows;
+            std::array<column, columns> stored;
+            std::string raw;
+            out.clear();
+
+            if (!split_columns(body, stored) || stored[0].type != encoding::delta || !read_column(stored[0], raw)) throw corrupted(path);
+            std::vector<time_t> timestamps;
+            std::vector<std::uint32_t> selected;
+            const char* q = raw.data();
+            for (std::uint32_t row = 0; row < rows; ++row) {
+                std::uint64_t delta;
+                if (!get_varint(q, raw.data() + raw.size(), delta)) throw corrupted(path);
+                const time_t timestamp = header.stats.min_timestamp + static_cast<time_t>(delta);
+                if (timestamp >= where.init && timestamp < where.end) {
+                    timestamps.push_back(timestamp);
+                    selected.push_back(row);
+                }
+            }
+
+            const std::pair<std::size_t, const std::optional<std::string>*> conditions[] = {{2, &where.lang}, {3, &where.user_id}, {6, &where.label}};
+            std::vector<std::string_view> values;
+            for (auto& condition: conditions) {
+                if (selected.empty()) return;
+                if (!*condition.second) continue;
+                const std::string& value = **condition.second;
+                const column& it = stored[condition.first];
+                if (!read_column(it, raw)) throw corrupted(path);
+                bool found = true;
+                if (it.type == encoding::dictionary && !in_dictionary(raw, value, found)) throw corrupted(path);
+                if (!found) {
+                    pruned.add();
+                    return;
+                }
+                if (!decode_strings(raw, it.type, rows, selected, values)) throw corrupted(path);
+                std::size_t kept = 0;
+                for (std::size_t i = 0; i < selected.size(); ++i) {
+                    if (values[i] != value) continue;
+                    selected[kept] = selected[i];
+                    timestamps[kept] = timestamps[i];
+                    ++kept;
+                }
+                selected.resize(kept);
+                timestamps.resize(kept);
+            }
+            if (selected.empty()) return;
+
+            out.resize(selected.size());
+            decode_column<1>(path, stored[1], rows, selected, out);
+            decode_column<2>(path, stored[2], rows, selected, out);
+            decode_column<3>(path, stored[3], rows, selected, out);
+            decode_column<4>(path, stored[4], rows, selected, out);
+            decode_column<5>(path, stored[5], rows, selected, out);
+            decode_column<6>(path, stored[6], rows, selected, out);
+
+            if (stored[7].type != encoding::plain || !read_column(stored[7], raw) || raw.size() != rows * sizeof(float)) throw corrupted(path);
+            for (std::size_t i = 0; i < selected.size(); ++i) {
+                std::get<0>(out[i]) = timestamps[i];
+                std::memcpy(&std::get<7>(out[i]), raw.data() + selected[i] * sizeof(float), sizeof(float));
+            }
+        }
+    }
+
+
+    ColumnarWriter::ColumnarWriter(std::string path, int compression_level)
+            : _path(std::move(path))
+            , _compression_level(compression_level)
+    {
+        // keep the chunks written completely, the file may end in the middle of one
+        struct stat st;
+        std::uint64_t valid = 0;
+        if (::stat(_path.c_str(), &st) == 0 && st.st_size > 0) {
+            const auto size = static_cast<std::uint64_t>(st.st_size);
+            file_ptr file{std::fopen(_path.c_str(), "rb"), &std::fclose};
+            if (!file) throw std::runtime_error("Cannot open columnar file '" + _path + "'");
+            // a file cut in the middle of the magic is ours too, anything else is never truncated
+            char buffer[sizeof(magic)];
+            const std::size_t length = std::fread(buffer, 1, sizeof(magic), file.get());
+            if (length < std::min<std::uint64_t>(size, sizeof(magic)) || std::memcmp(buffer, magic, length) != 0) {
+                throw std::runtime_error("Not a columnar file '" + _path + "'");
+            }
+            if (length == sizeof(magic)) {
+                valid = sizeof(magic);
+                chunk_header header;
+                while (read_header(file.get(), header) && valid + header_size + header.body_size <= size) {
+                    valid += header_size + header.body_size;
+                    std::fseek(file.get(), valid, SEEK_SET);
+                }
+            }
+            if (valid < size && ::truncate(_path.c_str(), valid) != 0) {
+                throw std::runtime_error("Cannot repair columnar file '" + _path + "'");
+            }
+        }
+        _file = std::fopen(_path.c_str(), "ab");
+        if (!_file) throw std::runtime_error("Cannot create columnar file '" + _path + "'");
+        if (valid == 0 && (std::fwrite(magic, 1, sizeof(magic), _file) != sizeof(magic) || std::fflush(_file) != 0)) {
+            throw std::runtime_error("Cannot write to columnar file '" + _path + "'");
+        }
+    }
+
+    ColumnarWriter::~ColumnarWriter() {
+        if (_file) std::fclose(_file);
+    }
+
+    void ColumnarWriter::insert(const std::vector<Tweet>& data) {
+        static auto& written = metrics::Registry::instance().counter("columnar_written_tweets_total", "Tweets stored in the columnar file");
+        static auto& bytes = metrics::Registry::instance().counter("columnar_written_bytes_total", "Bytes appended to the columnar file");
+        static auto& latency = metrics::Registry::instance().histogram("columnar_insert_seconds", "Time to encode and store a batch of tweets in the columnar file");
+        if (data.empty()) return;
+        metrics::Timer timer{latency};
+
+        chunk_stats stats;
+        stats.rows = data.size();
+        stats.min_timestamp = stats.max_timestamp = std::get<0>(data.front());
+        for (auto& tweet: data) {
+            stats.min_timestamp = std::min(stats.min_timestamp, std::get<0>(tweet));
+            stats.max_timestamp = std::max(stats.max_timestamp, std::get<0>(tweet));
+        }
+
+        std::string body, raw;
+        for (auto& tweet: data) put_varint(raw, static_cast<std::uint64_t>(std::get<0>(tweet) - stats.min_timestamp));
+        append_column(body, encoding::delta, raw, _compression_level);
+        auto strings = [&](encoding (*encode)(const std::vector<Tweet>&, std::string&)) {
+            raw.clear();
+            const encoding type = encode(data, raw);
+            append_column(body, type, raw, _compression_level);
+        };
+        strings(&encode_strings<1>);
+        strings(&encode_strings<2>);
+        strings(&encode_strings<3>);
+        strings(&encode_strings<4>);
+        strings(&encode_strings<5>);
+        strings(&encode_strings<6>);
+        raw.clear();
+        for (auto& tweet: data) put(raw, std::get<7>(tweet));
+        append_column(body, encoding::plain, raw, _compression_level);
+
+        std::string chunk;
+        chunk.reserve(header_size + body.size());
+        put(chunk, stats.rows);
+        put(chunk, static_cast<std::int64_t>(stats.min_timestamp));
+        put(chunk, static_cast<std::int64_t>(stats.max_timestamp));
+        put(chunk, static_cast<std::uint32_t>(body.size()));
+        put(chunk, static_cast<std::uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(body.data()), body.size())));
+        chunk += body;
+        if (std::fwrite(chunk.data(), 1, chunk.size(), _file) != chunk.size() || std::fflush(_file) != 0) {
+            throw std::runtime_error("Cannot write to columnar file '" + _path + "'");
+        }
+        written.add(data.size());
+        bytes.add(chunk.size());
+    }
+
+
+    ColumnarReader::ColumnarReader(std::string path) : _path(std::move(path)) {}
+
+    std::vector<Tweet> ColumnarReader::all() {
+        return filter(std::numeric_limits<time_t>::min(), std::numeric_limits<time_t>::max());
+    }
+
+    std::vector<Tweet> ColumnarReader::filter(time_t init, time_t end) {
+        predicate where;
+        where.init = init;
+        where.end = end;
+        return filter(where);
+    }
+
+    std::vector<Tweet> ColumnarReader::filter(const predicate& where) {
+        std::vector<Tweet> ret;
+        scan(where, [&ret](std::vector<Tweet>& tweets) {
+            ret.insert(ret.end(), std::make_move_iterator(tweets.begin()), std::make_move_iterator(tweets.end()));
+        });
+        return ret;
+    }
+
+    void ColumnarReader::scan(time_t init, time_t end, const std::function<void(std::vector<Tweet>&)>& f) {
+        predicate where;
+        where.init = init;
+        where.end = end;
+        scan(where, f);
+    }
+
+    void ColumnarReader::scan(const predicate& where, const std::function<void(std::vector<Tweet>&)>& f) {
+        static auto& read = metrics::Registry::instance().counter("columnar_read_tweets_total", "Tweets read from the columnar file");
+        static auto& skipped = metrics::Registry::instance().counter("columnar_skipped_chunks_total", "Chunks of the columnar file out of the range of a scan");
+        auto file = open(_path);
+        chunk_header header;
+        std::string body;
+        std::vector<Tweet> tweets;
+        while (read_header(file.get(), header)) {
+            if (header.stats.max_timestamp < where.init || header.stats.min_timestamp >= where.end) {
+                skipped.add(1);
+                if (std::fseek(file.get(), header.body_size, SEEK_CUR) != 0) break;
+                continue;
+            }
+            body.resize(header.body_size);
+            // the chunk is still being written
+            if (std::fread(&body[0], 1, body.size(), file.get()) != body.size()) break;
+            if (crc32(0, reinterpret_cast<const Bytef*>(body.data()), body.size()) != header.crc) throw corrupted(_path);
+            decode_chunk(_path, header, body, where, tweets);
+            if (tweets.empty()) continue;
+            read.add(tweets.size());
+            f(tweets);
+        }
+    }
+
+    std::vector<chunk_stats> ColumnarReader::chunks() {
+        auto file = open(_path);
+        struct stat st;
+        if (::fstat(::fileno(file.get()), &st) != 0) throw std::runtime_error("Cannot open columnar file '" + _path + "'");
+        std::vector<chunk_stats> ret;
+        chunk_header header;
+        std::uint64_t position = sizeof(magic);
+        while (read_header(file.get(), header)) {
+            position += header_size + header.body_size;
+            // the chunk is still being written
+            if (position > static_cast<std::uint64_t>(st.st_size) || std::fseek(file.get(), position, SEEK_SET) != 0) break;
+            ret.push_back(header.stats);
+        }
+        return ret;
+    }
+
+}
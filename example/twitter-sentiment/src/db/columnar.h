@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "tweet.h"
+
+namespace db {
+
+    // Local append-only file with the tweets stored by columns, for offline analytics. Every batch is a
+    //  chunk with its first and last timestamp in the header, so a reader skips the chunks out of the
+    //  time range it wants without reading them:
+    //
+    //    file:   magic, chunk, chunk, ...
+    //    chunk:  rows, min timestamp, max timestamp, body size, body crc32, body
+    //    body:   one column after the other (encoding, size, compressed size, zlib data) in the order
+    //            of db::Tweet: timestamp, id_str, lang, user_id, hashtags, text, label, score
+    //
+    // Timestamps are stored as the difference with the minimum of the chunk, and strings with few distinct
+    //  values in the chunk (lang, label, user_id of bots...) as indices to a dictionary of them. A scan for
+    //  one of those values skips the chunks whose dictionary doesn't have it.
+
+    struct chunk_stats {
+        std::uint32_t rows = 0;
+        time_t min_timestamp = 0;
+        time_t max_timestamp = 0;
+    };
+
+    // Rows a scan returns: 'init <= timestamp < end' and the given values of lang, user_id and label
+    struct predicate {
+        time_t init = std::numeric_limits<time_t>::min();
+        time_t end = std::numeric_limits<time_t>::max();
+        std::optional<std::string> lang;
+        std::optional<std::string> user_id;
+        std::optional<std::string> label;
+    };
+
+    class ColumnarWriter {
+    public:
+        // Appends to the file if it exists (a chunk left half written by a crash is removed first), it
+        //  throws if the file is not empty and it is not a columnar file
+        explicit ColumnarWriter(std::string path, int compression_level = 6);
+        ~ColumnarWriter();
+        ColumnarWriter(const ColumnarWriter&) = delete;
+        ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+        // Writes the tweets as one chunk, they are in the file when it returns
+        void insert(const std::vector<Tweet>& data);
+
+    protected:
+        const std::string _path;
+        const int _compression_level;
+        std::FILE* _file = nullptr;
+    };
+
+    // Reads the file written by ColumnarWriter, it can be used while the writer is appending to it (the
+    //  chunk being written is not read).
+    class ColumnarReader {
+    public:
+        explicit ColumnarReader(std::string path);
+
+        std::vector<Tweet> all();
+        // Tweets with 'init <= timestamp < end'
+        std::vector<Tweet> filter(time_t init, time_t end);
+        std::vector<Tweet> filter(const predicate& where);
+        // Calls 'f' with the tweets of each chunk in the range, only the chunks whose stats overlap it are
+        //  read and decompressed
+        void scan(time_t init, time_t end, const std::function<void(std::vector<Tweet>&)>& f);
+        void scan(const predicate& where, const std::function<void(std::vector<Tweet>&)>& f);
+
+        // Stats of the chunks in the file, only the headers are read
+        std::vector<chunk_stats> chunks();
+
+    protected:
+        const std::string _path;
+    };
+
+}
@@ -1,16 +1,19 @@
 
 #include "tweet.h"
 
+#include <cmath>
 #include <iomanip>
 #include <sstream>
 #include <iostream>
 #include <fmt/format.h>
 
+#include "../metrics.h"
+
 namespace db {
 
     namespace {
         const std::string table_name = "tweets_eurovision";
-        const std::vector<std::string> fields = {"timestamp_ms", "id_str", "lang", "user_id", "hashtags", "text"};
+        const std::vector<std::string> fields = {"timestamp_ms", "id_str", "lang", "user_id", "hashtags", "text", "label", "score"};
 
         pqxx::result run_query(pqxx::connection &connection, const std::string &query) {
             pqxx::work work(connection);
@@ -23,13 +26,46 @@ namespace db {
                 throw;
             }
         }
+
+        // NaN and infinity are not valid SQL literals, such scores are stored as NULL (read back as 0)
+        std::string score(float value) {
+            if (!std::isfinite(value)) return "NULL";
+            std::ostringstream os;
+            os << value;
+            return os.str();
+        }
+
+        Tweet parse(const pqxx::row& item) {
+            return std::make_tuple(item[0].as<time_t>(), item[1].as<std::string>(), item[2].as<std::string>(), item[3].as<std::string>(), item[4].as<std::string>(), item[5].as<std::string>(),
+                                   item[6].as<std::string>(std::string{}), item[7].as<float>(0.f));
+        }
+    }
+
+
+    TweetCursor::TweetCursor(pqxx::connection& connection, const std::string& query, std::size_t batch_size)
+            : _work(connection)
+            , _cursor(_work, query, "tweets_cursor", static_cast<pqxx::icursorstream::difference_type>(batch_size))
+    {}
+
+    bool TweetCursor::next(std::vector<Tweet>& rows) {
+        static auto& read = metrics::Registry::instance().counter("db_read_tweets_total", "Tweets read with a cursor");
+        rows.clear();
+        pqxx::result result;
+        if (!(_cursor >> result) || result.empty()) return false;
+        rows.reserve(result.size());
+        for (auto item: result) {
+            rows.emplace_back(parse(item));
+        }
+        read.add(rows.size());
+        return true;
     }
 
 
     TweetManager::TweetManager(pqxx::connection &connection) : _connection(connection) {}
 
     void TweetManager::create() {
-        auto result = run_query(_connection, fmt::format("SELECT to_regclass('public.{}');", table_name));
+        // in the first schema of the search path where the table is, the one the other queries use
+        auto result = run_query(_connection, fmt::format("SELECT to_regclass('{}');", table_name));
         if (result[0][0].is_null()) {
             run_query(_connection, fmt::format("CREATE TABLE {} ("
                                                "    {} bigint,"
@@ -37,8 +73,15 @@ namespace db {
                                                "    {} varchar(10),"
                                                "    {} varchar,"
                                                "    {} varchar,"
-                                               "    {} varchar)", table_name, fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]));
+                                               "    {} varchar,"
+                                               "    {} varchar,"
+                                               "    {} real)", table_name, fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], fields[6], fields[7]));
+        } else {
+            // tables created before tweets were classified
+            run_query(_connection, fmt::format("ALTER TABLE {} ADD COLUMN IF NOT EXISTS {} varchar, ADD COLUMN IF NOT EXISTS {} real", table_name, fields[6], fields[7]));
         }
+        // 'update' finds the rows by id (not unique: old tables may have duplicates)
+        run_query(_connection, fmt::format("CREATE INDEX IF NOT EXISTS {0}_{1}_idx ON {0} ({1})", table_name, fields[1]));
     }
 
     void TweetManager::remove() {
@@ -46,10 +89,10 @@ namespace db {
     }
 
     std::vector<Tweet> TweetManager::all() {
-        auto result = run_query(_connection, fmt::format("SELECT {}, {}, {}, {}, {}, {} FROM {}", fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], table_name));
+        auto result = run_query(_connection, fmt::format("SELECT {}, {}, {}, {}, {}, {}, {}, {} FROM {}", fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], fields[6], fields[7], table_name));
         std::vector<Tweet> ret;
         for (auto item: result) {
-            ret.emplace_back(std::make_tuple(item[0].as<time_t>(), item[1].as<std::string>(), item[2].as<std::string>(), item[3].as<std::string>(), item[4].as<std::string>(), item[5].as<std::string>()));
+            ret.emplace_back(parse(item));
         }
         return ret;
     }
@@ -61,14 +104,22 @@ namespace db {
     }
 
     void TweetManager::insert(const std::vector<Tweet>& data) {
+        static auto& inserted = metrics::Registry::instance().counter("db_inserted_tweets_total", "Tweets stored in the database");
+        static auto& latency = metrics::Registry::instance().histogram("db_insert_seconds", "Time to store a batch of tweets");
+        metrics::Timer timer{latency};
+        run_query(_connection, insert_query(data));
+        inserted.add(data.size());
+    }
+
+    std::string TweetManager::insert_query(const std::vector<Tweet>& data) {
         std::ostringstream os;
-        os << "INSERT INTO " << table_name << " (" << fields[0] << ", " << fields[1] << ", " << fields[2] << ", " << fields[3] << ", " << fields[4] << ", " << fields[5] << ") values ";
+        os << "INSERT INTO " << table_name << " (" << fields[0] << ", " << fields[1] << ", " << fields[2] << ", " << fields[3] << ", " << fields[4] << ", " << fields[5] << ", " << fields[6] << ", " << fields[7] << ") values ";
         for (auto it = data.begin(); it != data.end(); ++it) {
             const Tweet& tw = *it;
             if (it != data.begin()) { os << ", "; }
-            os << "('" << std::get<0>(tw) << "', '" << std::get<1>(tw) << "', '" << std::get<2>(tw) << "', '" << std::get<3>(tw) << "', '" << std::get<4>(tw) << "', " << std::quoted(std::get<5>(tw), '\'', '\'') << ")";
+            os << "('" << std::get<0>(tw) << "', '" << std::get<1>(tw) << "', '" << std::get<2>(tw) << "', '" << std::get<3>(tw) << "', '" << std::get<4>(tw) << "', " << std::quoted(std::get<5>(tw), '\'', '\'') << ", " << std::quoted(std::get<6>(tw), '\'', '\'') << ", " << score(std::get<7>(tw)) << ")";
         }
-        run_query(_connection, os.str());
+        return os.str();
     }
 
     std::vector<Tweet> TweetManager::filter(time_t init, time_t end) {
@@ -76,4 +127,35 @@ namespace db {
         return ret;
     }
 
+    std::unique_ptr<TweetCursor> TweetManager::cursor(const std::string& lang, bool labelled, std::size_t batch_size) {
+        std::vector<std::string> conditions;
+        if (!lang.empty()) conditions.push_back(fmt::format("{} = {}", fields[2], _connection.quote(lang)));
+        if (labelled) conditions.push_back(fmt::format("{0} IS NOT NULL AND {0} <> ''", fields[6]));
+        std::string query = fmt::format("SELECT {}, {}, {}, {}, {}, {}, {}, {} FROM {}", fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], fields[6], fields[7], table_name);
+        for (auto it = conditions.begin(); it != conditions.end(); ++it) {
+            query += (it == conditions.begin() ? " WHERE " : " AND ") + *it;
+        }
+        return std::make_unique<TweetCursor>(_connection, query, batch_size);
+    }
+
+    void TweetManager::update(const std::vector<Label>& labels) {
+        static auto& updated = metrics::Registry::instance().counter("db_updated_tweets_total", "Tweets labelled again in the database");
+        static auto& latency = metrics::Registry::instance().histogram("db_update_seconds", "Time to update the labels of a batch of tweets");
+        if (labels.empty()) return;
+        metrics::Timer timer{latency};
+        run_query(_connection, update_query(labels));
+        updated.add(labels.size());
+    }
+
+    std::string TweetManager::update_query(const std::vector<Label>& labels) {
+        std::ostringstream os;
+        os << "UPDATE " << table_name << " SET " << fields[6] << " = v." << fields[6] << ", " << fields[7] << " = v." << fields[7] << " FROM (VALUES ";
+        for (auto it = labels.begin(); it != labels.end(); ++it) {
+            if (it != labels.begin()) { os << ", "; }
+            os << "(" << std::quoted(std::get<0>(*it), '\'', '\'') << ", " << std::quoted(std::get<1>(*it), '\'', '\'') << ", " << score(std::get<2>(*it)) << "::real)";
+        }
+        os << ") AS v(" << fields[1] << ", " << fields[6] << ", " << fields[7] << ") WHERE " << table_name << "." << fields[1] << " = v." << fields[1];
+        return os.str();
+    }
+
 }
\ No newline at end of file
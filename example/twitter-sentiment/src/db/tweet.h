@@ -1,12 +1,31 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
 #include <tuple>
+#include <vector>
 #include <pqxx/pqxx>
 
 namespace db {
 
-    typedef std::tuple<time_t, std::string, std::string, std::string, std::string, std::string> Tweet; // timestamp_ms, id_str, lang, user_id, hashtags, text
+    typedef std::tuple<time_t, std::string, std::string, std::string, std::string, std::string, std::string, float> Tweet; // timestamp_ms, id_str, lang, user_id, hashtags, text, label, score
+
+    typedef std::tuple<std::string, std::string, float> Label; // id_str, label, score
+
+    // Reads the rows of a query in batches, the whole result is never in memory. It keeps a transaction
+    //  open on the connection while it exists, use another connection to write meanwhile.
+    class TweetCursor {
+    public:
+        TweetCursor(pqxx::connection&, const std::string& query, std::size_t batch_size);
+
+        // Returns false when there are no more rows
+        bool next(std::vector<Tweet>& rows);
+
+    protected:
+        pqxx::work _work;
+        pqxx::icursorstream _cursor;
+    };
 
     class TweetManager {
     public:
@@ -18,8 +37,15 @@ namespace db {
         std::vector<Tweet> all();
         void insert(time_t timestamp, const std::string&, const std::string&, const std::string&, const std::string& hashtags, const std::string& message);
         void insert(const std::vector<Tweet>& data);
+        static std::string insert_query(const std::vector<Tweet>& data);
         std::vector<Tweet> filter(time_t init, time_t end);
 
+        // Tweets in the language (all of them if empty), only the ones with a label if 'labelled'
+        std::unique_ptr<TweetCursor> cursor(const std::string& lang = {}, bool labelled = false, std::size_t batch_size = 10000);
+        // Sets label and score of the given tweets with a single statement
+        void update(const std::vector<Label>& labels);
+        static std::string update_query(const std::vector<Label>& labels);
+
         //void update(const Tweet& tweet);
         //void remove(Tweet& tweet);
         //Tweet get(int id);
@@ -0,0 +1,81 @@
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+
+namespace utils {
+
+    // Bounded cache that evicts the least recently used entries. It is split into shards (each one
+    //  with its own lock and its share of the capacity), so concurrent users seldom wait.
+    template <class Key, class Value, class Hash = std::hash<Key>>
+    class LruCache {
+    public:
+        explicit LruCache(std::size_t capacity, std::size_t shards = 16)
+                : _nshards(shards)
+                , _shards(new Shard[shards])
+        {
+            for (std::size_t i = 0; i < shards; ++i) {
+                _shards[i].capacity = std::max<std::size_t>(1, capacity / shards);
+            }
+        }
+
+        bool get(const Key& key, Value& value) {
+            Shard& shard = this->shard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it == shard.index.end()) return false;
+            shard.items.splice(shard.items.begin(), shard.items, it->second);
+            value = it->second->second;
+            return true;
+        }
+
+        void put(const Key& key, Value value) {
+            Shard& shard = this->shard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                it->second->second = std::move(value);
+                shard.items.splice(shard.items.begin(), shard.items, it->second);
+                return;
+            }
+            shard.items.emplace_front(key, std::move(value));
+            shard.index.emplace(key, shard.items.begin());
+            if (shard.items.size() > shard.capacity) {
+                shard.index.erase(shard.items.back().first);
+                shard.items.pop_back();
+            }
+        }
+
+        void clear() {
+            for (std::size_t i = 0; i < _nshards; ++i) {
+                std::lock_guard<std::mutex> lock(_shards[i].mutex);
+                _shards[i].index.clear();
+                _shards[i].items.clear();
+            }
+        }
+
+    protected:
+        struct Shard {
+            std::mutex mutex;
+            std::size_t capacity = 0;
+            std::list<std::pair<Key, Value>> items;  // most recently used first
+            std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> index;
+        };
+
+        Shard& shard(const Key& key) {
+            // use the high bits, the low ones are used by the map inside the shard
+            const std::size_t h = Hash{}(key);
+            return _shards[(h ^ (h >> 32)) % _nshards];
+        }
+
+        const std::size_t _nshards;
+        std::unique_ptr<Shard[]> _shards;
+    };
+}
@@ -1,9 +1,19 @@
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <string>
 #include <iostream>
 #include <fmt/format.h>
 #include "twitter.h"
+#include "utils.h"
+#include "classifier.h"
+#include "memo.h"
+#include "metrics.h"
+#include "db/columnar.h"
 #include "db/database.h"
+#include "pipeline/backpressure.h"
+#include "pipeline/batching.h"
 
 #include <range/v3/all.hpp>
 
@@ -14,6 +24,12 @@ std::string humanize(time_t tm) {
     return std::string(buf);
 }
 
+// SIGHUP asks to reload the classification models
+std::atomic<bool> reload_models{false};
+extern "C" void on_sighup(int) {
+    reload_models = true;
+}
+
 std::string get_env(const std::string& env_var) {
     const char* value = std::getenv(env_var.c_str());
     if (!value) {
@@ -22,6 +38,13 @@ std::string get_env(const std::string& env_var) {
     return value;
 }
 
+// A batch of tweets with their predictions, on its way from the classifier to the storage
+struct classified_batch {
+    std::vector<twitter::Tweet> tweets;
+    std::vector<classifier::Prediction> predictions;
+    std::chrono::steady_clock::duration elapsed{};  // time spent classifying it
+};
+
 
 int main() {
     // Inputs related to Twitter API
@@ -30,8 +53,40 @@ int main() {
     const std::string tw_consumer_secret = get_env("TW_CONSUMER_SECRET");
     const std::string tw_access_token_secret = get_env("TW_ACCESS_TOKEN_SECRET");
 
-    // Create database if not exists
-    db::Database::instance().tweets().create();
+    // Tweets go to a local columnar file instead of the database if one is given (for offline analytics)
+    std::shared_ptr<db::ColumnarWriter> columnar;
+    if (const char* path = std::getenv("COLUMNAR_FILE")) {
+        columnar = std::make_shared<db::ColumnarWriter>(path);
+    } else {
+        // Create database if not exists
+        db::Database::instance().tweets().create();
+    }
+
+    // One model per language, loaded when the first tweet in that language arrives
+    std::shared_ptr<classifier::ModelCache> models;
+    if (const char* pattern = std::getenv("FASTTEXT_MODELS")) {
+        classifier::cache_options options;
+        options.path_pattern = pattern;
+        if (const char* budget = std::getenv("FASTTEXT_MODELS_BUDGET_MB")) {
+            options.memory_budget = std::stoull(budget) * 1024 * 1024;
+        }
+        if (const char* pinned = std::getenv("FASTTEXT_MODELS_PINNED")) {
+            for (auto& lang: utils::split(pinned, ",", utils::Split::RemoveDelimiter)) {
+                options.pinned.insert(lang);
+            }
+        }
+        if (const char* storage = std::getenv("FASTTEXT_MODELS_STORAGE")) {
+            options.storage = fasttext::parseStorage(storage);
+        }
+        if (const char* subwords = std::getenv("FASTTEXT_MODELS_SUBWORDS")) {
+            options.subword_cache = std::stoull(subwords);
+        }
+        models = std::make_shared<classifier::ModelCache>(options);
+    }
+    // Retweets and copies of the same text are classified only once
+    classifier::memo_options memo_options;
+    memo_options.near_duplicates = !!std::getenv("MEMO_NEAR_DUPLICATES");
+    auto memo = std::make_shared<classifier::Memo>(memo_options);
 
     auto tweetthread = rxcpp::observe_on_new_thread();
     auto poolthread = rxcpp::observe_on_event_loop();
@@ -44,16 +99,59 @@ int main() {
     std::string method = isFilter ? "POST" : "GET";
     std::string url = tw_url_filter;
 
+    // Bounded queues between stages, so a slow database cannot make us buffer tweets until we run out of memory
+    pipeline::queue_options<std::string> chunk_queue;
+    chunk_queue.capacity = 1000;
+    chunk_queue.policy = pipeline::overflow::Block;
+
+    // per parsing thread
+    pipeline::queue_options<std::string> line_queue;
+    line_queue.capacity = 1000;
+    line_queue.policy = pipeline::overflow::Block;
+
+    pipeline::queue_options<twitter::Tweet> tweet_queue;
+    tweet_queue.capacity = 20000;
+    tweet_queue.policy = pipeline::overflow::DropOldest;
+    auto tweet_buffer = std::make_shared<pipeline::bounded_queue<twitter::Tweet>>(tweet_queue);
+
+    pipeline::queue_options<std::vector<twitter::Tweet>> batch_queue;
+    batch_queue.capacity = 16;
+    batch_queue.policy = pipeline::overflow::Spill;
+    batch_queue.spill_path = "tweets.spill";
+    batch_queue.encode = [](const std::vector<twitter::Tweet>& tws) {
+        std::string record;
+        for (auto& tw: tws) {
+            record += tw.data->tweet.dump() + "\n";
+        }
+        return record;
+    };
+    batch_queue.decode = [](const std::string& record) {
+        std::vector<twitter::Tweet> tws;
+        for (auto& line: utils::split(record, "\n", utils::Split::RemoveDelimiter)) {
+            if (!line.empty()) tws.emplace_back(nlohmann::json::parse(line));
+        }
+        return tws;
+    };
+    auto batch_buffer = std::make_shared<pipeline::bounded_queue<std::vector<twitter::Tweet>>>(batch_queue);
+
+    // if storing falls behind, classification waits and batches pile up (and spill) in the queue above
+    pipeline::queue_options<classified_batch> classified_queue;
+    classified_queue.capacity = 4;
+    classified_queue.policy = pipeline::overflow::Block;
+    auto classified_buffer = std::make_shared<pipeline::bounded_queue<classified_batch>>(classified_queue);
+
     rxcpp::observable<std::string> chunks;
     chunks = twitter::twitterrequest(tweetthread, factory, url, method, tw_consumer_key, tw_consumer_secret, tw_access_token, tw_access_token_secret) |
              // handle invalid requests by waiting for a trigger to try again
              rxcpp::operators::on_error_resume_next([](std::exception_ptr ep){
                  std::cerr << rxcpp::rxu::what(ep) << std::endl;
                  return rxcpp::rxs::never<std::string>();
-             });
+             }) |
+             // if framing falls behind, stop reading from the connection
+             pipeline::bounded(std::make_shared<pipeline::bounded_queue<std::string>>(chunk_queue));
 
     auto tweets = chunks |
-                  twitter::parsetweets(poolthread, tweetthread) |
+                  twitter::parsetweets(line_queue, tweetthread) |
                   rxcpp::rxo::map([](twitter::parsedtweets p){
                       p.errors |
                       rxcpp::operators::tap([](twitter::parseerror e){
@@ -62,7 +160,8 @@ int main() {
                       rxcpp::operators::subscribe<twitter::parseerror>();
                       return p.tweets;
                   }) |
-                  rxcpp::operators::merge(tweetthread);
+                  rxcpp::operators::merge(tweetthread) |
+                  pipeline::bounded(tweet_buffer);
 
     //tweets |
     //    rxcpp::rxo::map([](twitter::Tweet& t) {
@@ -72,25 +171,84 @@ int main() {
     //    rxcpp::operators::subscribe<std::string>(rxcpp::util::println(std::cout));
 
 
+    // batches adapt their size to the time it takes to store them
+    pipeline::batch_options batching;
+    batching.max_latency = std::chrono::milliseconds(2000);
+    auto batch_controller = std::make_shared<pipeline::batch_controller>(batching);
+
+    // Metrics about the pipeline itself, exported together with the ones recorded in every stage
+    auto& registry = metrics::Registry::instance();
+    registry.gauge("pipeline_batch_target", "Number of tweets the batcher is aiming for", [=](){ return batch_controller->target(); });
+    registry.gauge("pipeline_batch_size", "Number of tweets in the last batch", [=](){ return batch_controller->batch_size(); });
+    registry.gauge("pipeline_batch_queue_depth", "Tweets waiting for the batch to be flushed", [=](){ return batch_controller->queue_depth(); });
+    registry.gauge("pipeline_tweet_queue_size", "Parsed tweets waiting to be batched", [=](){ return tweet_buffer->size(); });
+    registry.counter("pipeline_tweet_queue_dropped_total", "Tweets dropped because the batcher was behind", [=](){ return tweet_buffer->dropped(); });
+    registry.gauge("pipeline_batch_queue_size", "Batches waiting to be classified", [=](){ return batch_buffer->size(); });
+    registry.counter("pipeline_batch_queue_spilled_total", "Batches spilled to disk", [=](){ return batch_buffer->spilled(); });
+    registry.counter("pipeline_batch_queue_replayed_total", "Batches replayed from disk", [=](){ return batch_buffer->replayed(); });
+    registry.gauge("pipeline_classified_queue_size", "Classified batches waiting to be stored", [=](){ return classified_buffer->size(); });
+
+    if (const char* port = std::getenv("METRICS_PORT")) {
+        metrics::serve(static_cast<unsigned short>(std::stoi(port)));
+    }
+    if (const char* path = std::getenv("METRICS_FILE")) {
+        std::string metrics_file{path};
+        rxcpp::observable<>::interval(std::chrono::seconds(10), poolthread) |
+            rxcpp::operators::subscribe<long>(lifetime, [=](long){ metrics::dump(metrics_file); });
+    }
+
+    // Replace the models while running when their files change (or on SIGHUP), in-flight batches finish with the old ones
+    if (models) {
+        std::signal(SIGHUP, on_sighup);
+        rxcpp::observable<>::interval(std::chrono::seconds(5), poolthread) |
+            rxcpp::operators::subscribe<long>(lifetime, [=](long){ models->check(reload_models.exchange(false)); });
+    }
+
     auto batch_tweets = tweets |
                         twitter::onlytweets() |
-                        rxcpp::rxo::buffer_with_time(std::chrono::milliseconds(2000), poolthread) |
+                        pipeline::adaptive_buffer<twitter::Tweet>(batch_controller, [](const twitter::Tweet& tw){ return tw.text().size(); }, poolthread) |
                         rxcpp::rxo::filter([](const std::vector<twitter::Tweet>& tws){ return !tws.empty(); }) |
                         rxcpp::rxo::publish() |
                         rxcpp::rxo::ref_count() |
                         rxcpp::rxo::as_dynamic();
 
-    // store tweets in the database (once every 2 seconds)
-    batch_tweets |
-            rxcpp::operators::subscribe<std::vector<twitter::Tweet>>([](std::vector<twitter::Tweet> tws) {
+    // classify the tweets of each batch (as soon as it is ready)
+    auto classified = batch_tweets |
+            pipeline::bounded(batch_buffer) |
+            rxcpp::rxo::map([models, memo](std::vector<twitter::Tweet> tws) {
+                auto start = std::chrono::steady_clock::now();
+                classified_batch batch;
+                batch.predictions.resize(tws.size());
+                if (models) {
+                    batch.predictions = classifier::classify(*models, tws, memo.get());
+                }
+                batch.tweets = std::move(tws);
+                batch.elapsed = std::chrono::steady_clock::now() - start;
+                return batch;
+            });
+
+    // store tweets in the database or the columnar file
+    classified |
+            pipeline::bounded(classified_buffer) |
+            rxcpp::operators::subscribe<classified_batch>([batch_controller, columnar](classified_batch batch) {
+                auto start = std::chrono::steady_clock::now();
+                auto& tws = batch.tweets;
+                auto& predictions = batch.predictions;
                 std::vector<db::Tweet> db_tweets; db_tweets.reserve(tws.size());
-                for (auto& tw: tws) {
+                for (std::size_t i = 0; i < tws.size(); ++i) {
+                    auto& tw = tws[i];
                     const std::vector<std::string>& hashtags{tw.hashtags()};
                     std::string hashtags_as_str{(hashtags | ranges::view::join(',') | ranges::to_<std::string>())};
-                    db_tweets.emplace_back(std::move(tw.timestamp()), std::move(tw.id_str()), std::move(tw.lang()), std::move(tw.user_id()), std::move(hashtags_as_str), std::move(tw.text()));
+                    db_tweets.emplace_back(std::move(tw.timestamp()), std::move(tw.id_str()), std::move(tw.lang()), std::move(tw.user_id()), std::move(hashtags_as_str), std::move(tw.text()),
+                                           std::move(predictions[i].label), predictions[i].probability);
+                }
+                std::cout << "About to save '" << tws.size() << "' tweets (target: " << batch_controller->target() << ", queued: " << batch_controller->queue_depth() << ")\n";
+                if (columnar) {
+                    columnar->insert(db_tweets);
+                } else {
+                    db::Database::instance().tweets().insert(db_tweets);
                 }
-                std::cout << "About to save '" << tws.size() << "' tweets\n";
-                db::Database::instance().tweets().insert(db_tweets);
+                batch_controller->report(tws.size(), batch.elapsed + (std::chrono::steady_clock::now() - start));
             });
 
 
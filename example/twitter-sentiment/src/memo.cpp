@@ -0,0 +1,158 @@
+
+#include "memo.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "metrics.h"
+
+namespace classifier {
+
+    namespace {
+        // splitmix64 finalizer, good enough to mix ids and hashes together
+        std::uint64_t mix(std::uint64_t x) {
+            x += 0x9e3779b97f4a7c15ULL;
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        }
+
+        std::uint64_t combine(std::uint64_t seed, std::uint64_t value) {
+            return mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+        }
+
+        enum key_type : std::uint64_t { Text = 1, Retweet = 2, Band = 3 };
+
+        std::uint64_t key(const Model& model, key_type type, std::uint64_t value) {
+            return combine(combine(model.generation(), type), value);
+        }
+
+        std::uint64_t hash(const std::vector<words::word_id>& ids) {
+            std::uint64_t ret = ids.size();
+            for (auto id: ids) ret = combine(ret, id);
+            return ret;
+        }
+    }
+
+    Memo::Exact Memo::retweet_of(const Model& model, const std::string& retweeted) {
+        Exact ret;
+        ret.generation = model.generation();
+        ret.retweet = true;
+        ret.text = retweeted;
+        return ret;
+    }
+
+    Memo::Exact Memo::text_of(const Model& model, const twitter::Tweet& tweet) {
+        Exact ret;
+        ret.generation = model.generation();
+        const auto& tokens = tweet.data->tokens;
+        if (std::all_of(tokens.begin(), tokens.end(), [](words::word_id id) { return id < words::Interner::overflow; })) {
+            ret.tokens = tokens;
+        } else {
+            ret.text = tweet.text();
+        }
+        return ret;
+    }
+
+    std::uint64_t Memo::key_of(const Exact& entry) {
+        const std::uint64_t value = entry.tokens.empty() ? std::hash<std::string>{}(entry.text) : hash(entry.tokens);
+        return combine(combine(entry.generation, entry.retweet ? Retweet : Text), value);
+    }
+
+    bool Memo::find_exact(const Exact& entry, Prediction& prediction) {
+        std::shared_ptr<const Exact> found;
+        if (!_exact.get(key_of(entry), found) || !found->matches(entry)) return false;
+        prediction = found->prediction;
+        return true;
+    }
+
+    void Memo::insert_exact(Exact entry, const Prediction& prediction) {
+        const std::uint64_t key = key_of(entry);
+        entry.prediction = prediction;
+        _exact.put(key, std::make_shared<const Exact>(std::move(entry)));
+    }
+
+    Memo::Memo(memo_options options)
+            : _options(options)
+            , _exact(options.capacity)
+            , _similar(options.near_duplicates ? options.capacity : 1)
+    {}
+
+    bool Memo::find(const Model& model, const twitter::Tweet& tweet, Prediction& prediction) {
+        static auto& retweets = metrics::Registry::instance().counter("classifier_memo_retweet_hits_total", "Predictions reused for a retweet");
+        static auto& exact = metrics::Registry::instance().counter("classifier_memo_exact_hits_total", "Predictions reused for the same text");
+        static auto& similar = metrics::Registry::instance().counter("classifier_memo_similar_hits_total", "Predictions reused for almost the same words");
+        static auto& misses = metrics::Registry::instance().counter("classifier_memo_misses_total", "Tweets that need to be classified");
+
+        const std::string retweeted = tweet.retweeted_id();
+        if (!retweeted.empty() && find_exact(retweet_of(model, retweeted), prediction)) {
+            retweets.add();
+            return true;
+        }
+
+        // the model sees the tokens in order, only the same tokens are sure to get the same prediction
+        if (find_exact(text_of(model, tweet), prediction)) {
+            exact.add();
+            return true;
+        }
+
+        const auto& words = tweet.data->words;
+        if (_options.near_duplicates && !words.empty()) {
+            const std::uint64_t h = simhash(words);
+            for (unsigned band = 0; band < bands; ++band) {
+                const std::uint64_t value = (h >> (16 * band)) & 0xffff;
+                std::vector<Similar> candidates;
+                if (!_similar.get(key(model, Band, (band << 16) | value), candidates)) continue;
+                for (auto& candidate: candidates) {
+                    if (__builtin_popcountll(candidate.simhash ^ h) <= static_cast<int>(_options.max_distance)) {
+                        prediction = candidate.prediction;
+                        similar.add();
+                        return true;
+                    }
+                }
+            }
+        }
+
+        misses.add();
+        return false;
+    }
+
+    void Memo::insert(const Model& model, const twitter::Tweet& tweet, const Prediction& prediction) {
+        const std::string retweeted = tweet.retweeted_id();
+        if (!retweeted.empty()) {
+            insert_exact(retweet_of(model, retweeted), prediction);
+        }
+
+        insert_exact(text_of(model, tweet), prediction);
+
+        const auto& words = tweet.data->words;
+        if (_options.near_duplicates && !words.empty()) {
+            const std::uint64_t h = simhash(words);
+            for (unsigned band = 0; band < bands; ++band) {
+                const std::uint64_t value = (h >> (16 * band)) & 0xffff;
+                const std::uint64_t band_key = key(model, Band, (band << 16) | value);
+                std::vector<Similar> candidates;
+                _similar.get(band_key, candidates);
+                // a few per band are enough, most texts are copies of a handful of originals
+                if (candidates.size() >= 8) candidates.erase(candidates.begin());
+                candidates.push_back({h, prediction});
+                _similar.put(band_key, std::move(candidates));
+            }
+        }
+    }
+
+    std::uint64_t Memo::simhash(const std::vector<words::word_id>& words) {
+        int weights[64] = {};
+        for (auto id: words) {
+            const std::uint64_t h = mix(id);
+            for (unsigned bit = 0; bit < 64; ++bit) {
+                weights[bit] += ((h >> bit) & 1) ? 1 : -1;
+            }
+        }
+        std::uint64_t ret = 0;
+        for (unsigned bit = 0; bit < 64; ++bit) {
+            if (weights[bit] > 0) ret |= std::uint64_t(1) << bit;
+        }
+        return ret;
+    }
+}
@@ -0,0 +1,70 @@
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "classifier.h"
+#include "lru.h"
+
+
+namespace classifier {
+
+    struct memo_options
+    {
+        std::size_t capacity = 100000;
+        // Also look for tweets with almost the same words (SimHash of the word ids)
+        bool near_duplicates = false;
+        // Maximum number of different bits between two SimHash to consider them duplicates (up to 3)
+        unsigned max_distance = 3;
+    };
+
+    // Remembers the predictions for the tweets already classified, so retweets and copies of
+    //  the same text (very common in the stream) don't need to go through the model again.
+    //  Entries are bound to the model that computed them, a new model (or a hot-swapped one)
+    //  never gets a prediction made by another one.
+    class Memo {
+    public:
+        explicit Memo(memo_options options = {});
+
+        bool find(const Model& model, const twitter::Tweet& tweet, Prediction& prediction);
+        void insert(const Model& model, const twitter::Tweet& tweet, const Prediction& prediction);
+
+        static std::uint64_t simhash(const std::vector<words::word_id>& words);
+
+    protected:
+        static constexpr unsigned bands = 4;  // pigeonhole: up to 3 different bits, at least one band is equal
+
+        // What the prediction was made from, compared on every hit: the hash in the key may collide
+        struct Exact {
+            std::uint64_t generation = 0;
+            bool retweet = false;
+            // tokens the model read ('Tweet::shared::tokens'), or only the text when some of them are
+            //  past the capacity of the interner (their ids may be shared by different words)
+            std::vector<words::word_id> tokens;
+            std::string text;  // or the id of the retweeted tweet
+            Prediction prediction;
+
+            bool matches(const Exact& other) const {
+                return generation == other.generation && retweet == other.retweet && tokens == other.tokens && text == other.text;
+            }
+        };
+
+        struct Similar {
+            std::uint64_t simhash;
+            Prediction prediction;
+        };
+
+        static Exact retweet_of(const Model& model, const std::string& retweeted);
+        static Exact text_of(const Model& model, const twitter::Tweet& tweet);
+        static std::uint64_t key_of(const Exact& entry);
+        bool find_exact(const Exact& entry, Prediction& prediction);
+        void insert_exact(Exact entry, const Prediction& prediction);
+
+        const memo_options _options;
+        utils::LruCache<std::uint64_t, std::shared_ptr<const Exact>> _exact;
+        utils::LruCache<std::uint64_t, std::vector<Similar>> _similar;
+    };
+}
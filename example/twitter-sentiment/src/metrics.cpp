@@ -0,0 +1,176 @@
+
+#include "metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace metrics {
+
+    Histogram::Histogram() {
+        for (auto& it: _counts) {
+            it.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::uint64_t Histogram::quantile(double q) const {
+        std::array<std::uint64_t, buckets> counts;
+        std::uint64_t total = 0;
+        for (unsigned i = 0; i < buckets; ++i) {
+            counts[i] = _counts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) return 0;
+
+        const auto rank = static_cast<std::uint64_t>(q * (total - 1));
+        std::uint64_t seen = 0;
+        for (unsigned i = 0; i < buckets; ++i) {
+            seen += counts[i];
+            if (seen > rank) return upper_bound(i);
+        }
+        return upper_bound(buckets - 1);
+    }
+
+    std::uint64_t Histogram::upper_bound(unsigned index) {
+        if (index < sub_buckets) return index;
+        const unsigned shift = index / sub_buckets - 1;
+        const std::uint64_t base = (std::uint64_t(sub_buckets) + (index % sub_buckets)) << shift;
+        return base + ((std::uint64_t(1) << shift) - 1);
+    }
+
+    Registry& Registry::instance() {
+        static Registry instance;
+        return instance;
+    }
+
+    Counter& Registry::counter(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& it = _counters[name];
+        if (!it.metric) {
+            it = {help, std::make_unique<Counter>()};
+        }
+        return *it.metric;
+    }
+
+    Histogram& Registry::histogram(const std::string& name, const std::string& help) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& it = _histograms[name];
+        if (!it.metric) {
+            it = {help, std::make_unique<Histogram>()};
+        }
+        return *it.metric;
+    }
+
+    void Registry::counter(const std::string& name, const std::string& help, std::function<double()> value) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _callbacks[name] = {help, std::move(value), "counter"};
+    }
+
+    void Registry::gauge(const std::string& name, const std::string& help, std::function<double()> value) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _callbacks[name] = {help, std::move(value), "gauge"};
+    }
+
+    void Registry::remove(const std::string& name) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _callbacks.erase(name);
+        }
+        // wait for an export that may still be calling it
+        std::lock_guard<std::mutex> reading(_reading);
+    }
+
+    std::string Registry::prometheus() const {
+        std::lock_guard<std::mutex> reading(_reading);
+        std::ostringstream os;
+        std::map<std::string, Callback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& it: _counters) {
+                os << "# HELP " << it.first << " " << it.second.help << "\n";
+                os << "# TYPE " << it.first << " counter\n";
+                os << it.first << " " << it.second.metric->value() << "\n";
+            }
+            callbacks = _callbacks;
+        }
+        for (auto& it: callbacks) {
+            os << "# HELP " << it.first << " " << it.second.help << "\n";
+            os << "# TYPE " << it.first << " " << it.second.type << "\n";
+            os << it.first << " " << it.second.value() << "\n";
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& it: _histograms) {
+            const Histogram& h = *it.second.metric;
+            os << "# HELP " << it.first << " " << it.second.help << "\n";
+            os << "# TYPE " << it.first << " summary\n";
+            for (double q: {0.5, 0.9, 0.99, 0.999}) {
+                os << it.first << "{quantile=\"" << q << "\"} " << h.quantile(q) / 1e9 << "\n";
+            }
+            os << it.first << "_sum " << h.sum() / 1e9 << "\n";
+            os << it.first << "_count " << h.count() << "\n";
+        }
+        return os.str();
+    }
+
+    void dump(const std::string& path) {
+        const std::string tmp = path + ".tmp";
+        {
+            std::ofstream os(tmp, std::ios::trunc);
+            os << Registry::instance().prometheus();
+        }
+        std::rename(tmp.c_str(), path.c_str());
+    }
+
+    void serve(unsigned short port) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create metrics socket");
+        }
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+            close(fd);
+            throw std::runtime_error("Cannot listen for metrics in port " + std::to_string(port));
+        }
+
+        std::thread([fd]() {
+            while (true) {
+                int client = accept(fd, nullptr, nullptr);
+                if (client < 0) continue;
+
+                // a client that never sends its request can't hold the only thread serving the metrics
+                timeval timeout{};
+                timeout.tv_sec = 5;
+                setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+                // we don't care about the request, every path returns the metrics
+                char request[1024];
+                recv(client, request, sizeof(request), 0);
+
+                const std::string body = Registry::instance().prometheus();
+                const std::string response = "HTTP/1.0 200 OK\r\n"
+                                             "Content-Type: text/plain; version=0.0.4\r\n"
+                                             "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                                             "\r\n" + body;
+                send(client, response.data(), response.size(), 0);
+                close(client);
+            }
+        }).detach();
+        std::cerr << "metrics available at http://127.0.0.1:" << port << "/metrics" << std::endl;
+    }
+}
@@ -0,0 +1,123 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+namespace metrics {
+
+    class Counter {
+    public:
+        void add(std::uint64_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+        std::uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+    protected:
+        alignas(64) std::atomic<std::uint64_t> _value{0};
+    };
+
+    // Log-linear histogram (HDR style): 16 buckets for every power of two, so any value is
+    //  recorded with an error lower than 1/16 (6.25%) using a fixed array of atomic counters.
+    class Histogram {
+    public:
+        static constexpr unsigned sub_bucket_bits = 4;
+        static constexpr unsigned sub_buckets = 1u << sub_bucket_bits;
+        static constexpr unsigned buckets = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+        Histogram();
+
+        void record(std::uint64_t value) {
+            _counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+            _count.fetch_add(1, std::memory_order_relaxed);
+            _sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        std::uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+        std::uint64_t sum() const { return _sum.load(std::memory_order_relaxed); }
+        // Upper bound of the bucket where the given quantile (0..1) falls
+        std::uint64_t quantile(double q) const;
+
+        static unsigned index(std::uint64_t value) {
+            if (value < sub_buckets) return static_cast<unsigned>(value);
+            const unsigned msb = 63 - __builtin_clzll(value);
+            const unsigned shift = msb - sub_bucket_bits;
+            return (shift + 1) * sub_buckets + static_cast<unsigned>((value >> shift) & (sub_buckets - 1));
+        }
+        static std::uint64_t upper_bound(unsigned index);
+
+    protected:
+        std::array<std::atomic<std::uint64_t>, buckets> _counts;
+        std::atomic<std::uint64_t> _count{0};
+        std::atomic<std::uint64_t> _sum{0};
+    };
+
+    // Records in the histogram the nanoseconds elapsed during its lifetime
+    class Timer {
+    public:
+        explicit Timer(Histogram& histogram) : _histogram(histogram), _start(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            _histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+        }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    protected:
+        Histogram& _histogram;
+        const std::chrono::steady_clock::time_point _start;
+    };
+
+    // Metrics are registered once (usually in a function-level static) and the references
+    //  returned are valid for the whole life of the program, only registration takes a lock.
+    class Registry {
+    public:
+        static Registry& instance();
+
+        Counter& counter(const std::string& name, const std::string& help);
+        // Counter kept somewhere else (it must never go down), its value is read when the metrics are exported
+        void counter(const std::string& name, const std::string& help, std::function<double()> value);
+        // Histograms of durations are recorded in nanoseconds and exported in seconds
+        Histogram& histogram(const std::string& name, const std::string& help);
+        // Value is read when the metrics are exported
+        void gauge(const std::string& name, const std::string& help, std::function<double()> value);
+        // Removes a counter or gauge kept somewhere else, once it returns its callback is not running and
+        //  won't be called again (objects it uses can be destroyed)
+        void remove(const std::string& name);
+
+        // Prometheus text exposition format
+        std::string prometheus() const;
+
+    protected:
+        Registry() = default;
+
+        template <class T>
+        struct Metric {
+            std::string help;
+            std::unique_ptr<T> metric;
+        };
+        struct Callback {
+            std::string help;
+            std::function<double()> value;
+            const char* type;
+        };
+
+        mutable std::mutex _mutex;
+        // held while the callbacks are called, without '_mutex': they may take locks of their own
+        mutable std::mutex _reading;
+        std::map<std::string, Metric<Counter>> _counters;
+        std::map<std::string, Metric<Histogram>> _histograms;
+        std::map<std::string, Callback> _callbacks;
+    };
+
+    // Writes the metrics to the given file (replacing it atomically)
+    void dump(const std::string& path);
+
+    // Serves the metrics in 'http://127.0.0.1:<port>/metrics' from a background thread
+    void serve(unsigned short port);
+}
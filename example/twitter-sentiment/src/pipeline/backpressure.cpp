@@ -0,0 +1,101 @@
+
+#include "backpressure.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace pipeline {
+
+    spill_file::spill_file(std::string path) : _path(std::move(path)) {
+        recover();
+    }
+
+    spill_file::~spill_file() {
+        if (_reader) std::fclose(_reader);
+        if (_writer) std::fclose(_writer);
+        // records not replayed yet are kept for the next run
+        if (!pending()) std::remove(_path.c_str());
+    }
+
+    void spill_file::append(const std::string& record) {
+        const std::uint32_t size = record.size();
+        if (std::fwrite(&size, sizeof(size), 1, _writer) != 1 || std::fwrite(record.data(), 1, size, _writer) != size) {
+            throw std::runtime_error("Cannot write to spill file '" + _path + "'");
+        }
+        // the record must be in the file if we crash before replaying it
+        std::fflush(_writer);
+        ++_written;
+    }
+
+    bool spill_file::read(std::string& record) {
+        if (!pending()) return false;
+
+        std::fflush(_writer);
+        if (!_reader) {
+            _reader = std::fopen(_path.c_str(), "rb");
+            if (!_reader) throw std::runtime_error("Cannot open spill file '" + _path + "'");
+        }
+
+        std::uint32_t size = 0;
+        if (std::fread(&size, sizeof(size), 1, _reader) != 1) {
+            throw std::runtime_error("Corrupted spill file '" + _path + "'");
+        }
+        record.resize(size);
+        if (std::fread(&record[0], 1, size, _reader) != size) {
+            throw std::runtime_error("Corrupted spill file '" + _path + "'");
+        }
+        ++_read;
+
+        // everything has been replayed, start again from an empty file
+        if (!pending()) {
+            reset();
+        }
+        return true;
+    }
+
+    std::size_t spill_file::pending() const {
+        return _written - _read;
+    }
+
+    void spill_file::recover() {
+        // count the records left by a previous run, a record half written by a crash is removed
+        long valid = 0;
+        if (std::FILE* file = std::fopen(_path.c_str(), "rb")) {
+            std::fseek(file, 0, SEEK_END);
+            const long end = std::ftell(file);
+            std::fseek(file, 0, SEEK_SET);
+            std::uint32_t size = 0;
+            while (std::fread(&size, sizeof(size), 1, file) == 1) {
+                const long next = valid + static_cast<long>(sizeof(size) + size);
+                if (next > end) break;
+                std::fseek(file, next, SEEK_SET);
+                valid = next;
+                ++_written;
+            }
+            std::fclose(file);
+            if (::truncate(_path.c_str(), valid) != 0) {
+                throw std::runtime_error("Cannot repair spill file '" + _path + "'");
+            }
+        }
+        _writer = std::fopen(_path.c_str(), "ab");
+        if (!_writer) {
+            throw std::runtime_error("Cannot create spill file '" + _path + "'");
+        }
+    }
+
+    void spill_file::reset() {
+        if (_reader) {
+            std::fclose(_reader);
+            _reader = nullptr;
+        }
+        if (_writer) {
+            std::fclose(_writer);
+        }
+        _writer = std::fopen(_path.c_str(), "wb");
+        if (!_writer) {
+            throw std::runtime_error("Cannot create spill file '" + _path + "'");
+        }
+        _written = _read = 0;
+    }
+}
@@ -0,0 +1,183 @@
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <rxcpp/rx.hpp>
+
+
+namespace pipeline {
+
+    // What to do when a stage produces faster than the next one consumes
+    enum class overflow {
+        Block,       // producer waits until there is room in the queue (it blocks the curl reader)
+        DropOldest,  // oldest item in the queue is discarded (and counted)
+        Spill        // items go to a local append-only file and are replayed when the consumer catches up
+    };
+
+    // Append-only file of length-prefixed records, read back in the same order they were written.
+    //  The records not read yet survive a restart: they are read first by the next spill_file opened
+    //  on the same path. What has been read is not recorded until the file is empty, so after a crash
+    //  some records may be read again (at-least-once).
+    class spill_file {
+    public:
+        explicit spill_file(std::string path);
+        ~spill_file();
+        spill_file(const spill_file&) = delete;
+        spill_file& operator=(const spill_file&) = delete;
+
+        void append(const std::string& record);
+        bool read(std::string& record);
+        std::size_t pending() const;
+
+    protected:
+        void recover();
+        void reset();
+
+        const std::string _path;
+        std::FILE* _writer = nullptr;
+        std::FILE* _reader = nullptr;
+        std::size_t _written = 0;
+        std::size_t _read = 0;
+    };
+
+    template <class T>
+    struct queue_options
+    {
+        std::size_t capacity = 10000;
+        overflow policy = overflow::Block;
+        // only used with the 'Spill' policy
+        std::string spill_path;
+        std::function<std::string(const T&)> encode;
+        std::function<T(const std::string&)> decode;
+    };
+
+    // Bounded FIFO queue between two stages of the pipeline, memory used by the items waiting in the
+    //  queue never goes beyond 'capacity' items whatever the policy is.
+    template <class T>
+    class bounded_queue {
+    public:
+        explicit bounded_queue(queue_options<T> options)
+                : _options(std::move(options))
+                , _spill(_options.policy == overflow::Spill ? std::make_unique<spill_file>(_options.spill_path) : nullptr)
+        {}
+
+        // Returns false if the queue was closed
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_options.policy == overflow::Block) {
+                _not_full.wait(lock, [this]{ return _closed || _items.size() < _options.capacity; });
+            }
+            if (_closed) return false;
+
+            if (_options.policy == overflow::Spill && (_spill->pending() || _items.size() >= _options.capacity)) {
+                // keep the order: once we start spilling, everything goes to the file until it is replayed
+                _spill->append(_options.encode(item));
+                ++_spilled;
+            } else {
+                if (_items.size() >= _options.capacity) {
+                    _items.pop_front();
+                    ++_dropped;
+                }
+                _items.push_back(std::move(item));
+            }
+            _not_empty.notify_one();
+            return true;
+        }
+
+        // Blocks until there is an item available, returns false if the queue is closed and empty
+        bool pop(T& item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [this]{ return _closed || !_items.empty() || (_spill && _spill->pending()); });
+            if (!_items.empty()) {
+                item = std::move(_items.front());
+                _items.pop_front();
+                _not_full.notify_one();
+                return true;
+            }
+            std::string record;
+            if (_spill && _spill->read(record)) {
+                item = _options.decode(record);
+                ++_replayed;
+                return true;
+            }
+            return false;
+        }
+
+        // Pending items can still be popped after closing the queue
+        void close() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _not_full.notify_all();
+            _not_empty.notify_all();
+        }
+
+        std::size_t size() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _items.size();
+        }
+        std::size_t dropped() const { return _dropped.load(); }
+        std::size_t spilled() const { return _spilled.load(); }
+        std::size_t replayed() const { return _replayed.load(); }
+
+    protected:
+        const queue_options<T> _options;
+        std::unique_ptr<spill_file> _spill;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _not_full;
+        std::condition_variable _not_empty;
+        std::deque<T> _items;
+        bool _closed = false;
+
+        std::atomic<std::size_t> _dropped{0};
+        std::atomic<std::size_t> _spilled{0};
+        std::atomic<std::size_t> _replayed{0};
+    };
+
+    // Decouples the upstream and downstream stages with a bounded queue: items are delivered
+    //  downstream from a dedicated thread.
+    template <class T>
+    auto bounded(std::shared_ptr<bounded_queue<T>> queue) -> std::function<rxcpp::observable<T>(rxcpp::observable<T>)> {
+        return [=](rxcpp::observable<T> source) -> rxcpp::observable<T> {
+            return rxcpp::observable<>::create<T>([=](rxcpp::subscriber<T> out) {
+                out.add([=](){ queue->close(); });
+                // errors are delivered after the pending items, from the consumer thread
+                auto error = std::make_shared<std::exception_ptr>();
+
+                auto consumer = rxcpp::schedulers::make_new_thread().create_worker(out.get_subscription());
+                consumer.schedule([=](const rxcpp::schedulers::schedulable&) {
+                    T item;
+                    while (out.is_subscribed() && queue->pop(item)) {
+                        out.on_next(std::move(item));
+                    }
+                    if (*error) {
+                        out.on_error(*error);
+                    } else {
+                        out.on_completed();
+                    }
+                });
+
+                source.subscribe(
+                        out.get_subscription(),
+                        [=](const T& item) {
+                            queue->push(item);
+                        },
+                        [=](std::exception_ptr ep) {
+                            *error = ep;
+                            queue->close();
+                        },
+                        [=]() {
+                            queue->close();
+                        });
+            });
+        };
+    }
+}
@@ -0,0 +1,58 @@
+
+#include "batching.h"
+
+#include <algorithm>
+
+namespace pipeline {
+
+    namespace {
+        // weight of the last batch in the moving average of the throughput
+        constexpr double alpha = 0.2;
+    }
+
+    batch_controller::batch_controller(batch_options options)
+            : _options(options)
+            , _target(options.min_count)
+            , _queue_depth(0)
+            , _batch_size(0)
+            , _throughput(0.0)
+    {}
+
+    const batch_options& batch_controller::options() const {
+        return _options;
+    }
+
+    std::size_t batch_controller::target() const {
+        return _target.load(std::memory_order_relaxed);
+    }
+
+    std::size_t batch_controller::queue_depth() const {
+        return _queue_depth.load(std::memory_order_relaxed);
+    }
+
+    std::size_t batch_controller::batch_size() const {
+        return _batch_size.load(std::memory_order_relaxed);
+    }
+
+    void batch_controller::report(std::size_t count, std::chrono::steady_clock::duration elapsed) {
+        if (count == 0) return;
+        const double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-6);
+        const double throughput = count / seconds;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _throughput = (_throughput == 0.0) ? throughput : alpha * throughput + (1.0 - alpha) * _throughput;
+
+        // as many items as downstream can process in the expected time
+        const double target = _throughput * std::chrono::duration<double>(_options.processing_time).count();
+        _target.store(std::clamp(static_cast<std::size_t>(target), _options.min_count, _options.max_count), std::memory_order_relaxed);
+    }
+
+    void batch_controller::queued(std::size_t count) {
+        _queue_depth.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void batch_controller::flushed(std::size_t count) {
+        _queue_depth.fetch_sub(count, std::memory_order_relaxed);
+        _batch_size.store(count, std::memory_order_relaxed);
+    }
+}
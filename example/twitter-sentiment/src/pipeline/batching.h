@@ -0,0 +1,121 @@
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <rxcpp/rx.hpp>
+
+
+namespace pipeline {
+
+    struct batch_options
+    {
+        std::size_t min_count = 10;
+        std::size_t max_count = 5000;
+        std::size_t max_bytes = 4 * 1024 * 1024;
+        std::chrono::milliseconds max_latency{2000};
+        // Time downstream should spend with each batch, target size adapts to match it
+        std::chrono::milliseconds processing_time{250};
+    };
+
+    // Keeps the target size of the batches according to the throughput observed downstream
+    class batch_controller {
+    public:
+        explicit batch_controller(batch_options options = {});
+
+        const batch_options& options() const;
+
+        // Number of items a batch should have before being flushed
+        std::size_t target() const;
+        // Items waiting in the buffer to be flushed
+        std::size_t queue_depth() const;
+        // Size of the last batch flushed
+        std::size_t batch_size() const;
+
+        // Downstream must report every batch it has processed and how long it took
+        void report(std::size_t count, std::chrono::steady_clock::duration elapsed);
+
+        void queued(std::size_t count);
+        void flushed(std::size_t count);
+
+    protected:
+        const batch_options _options;
+        std::atomic<std::size_t> _target;
+        std::atomic<std::size_t> _queue_depth;
+        std::atomic<std::size_t> _batch_size;
+
+        std::mutex _mutex;
+        double _throughput;  // items per second (moving average)
+    };
+
+    // Like 'buffer_with_time', but it flushes the buffer when the first of these happens:
+    //  * it reaches the target count given by the controller (never more than 'max_count'),
+    //  * the items in it add more than 'max_bytes' (as measured by 'bytes'),
+    //  * the oldest item has been waiting for 'max_latency'.
+    template <class T, class Coordination>
+    auto adaptive_buffer(std::shared_ptr<batch_controller> controller, std::function<std::size_t(const T&)> bytes, Coordination coordination)
+            -> std::function<rxcpp::observable<std::vector<T>>(rxcpp::observable<T>)> {
+        return [=](rxcpp::observable<T> source) -> rxcpp::observable<std::vector<T>> {
+            return rxcpp::observable<>::create<std::vector<T>>([=](rxcpp::subscriber<std::vector<T>> out) {
+                struct state_type {
+                    std::mutex mutex;
+                    std::vector<T> buffer;
+                    std::size_t bytes = 0;
+                    std::chrono::steady_clock::time_point oldest;
+                };
+                auto state = std::make_shared<state_type>();
+
+                // must be called holding the lock, so batches are delivered in order
+                auto flush = [=]() {
+                    if (state->buffer.empty()) return;
+                    std::vector<T> batch;
+                    batch.swap(state->buffer);
+                    state->bytes = 0;
+                    controller->flushed(batch.size());
+                    out.on_next(std::move(batch));
+                };
+
+                const auto& options = controller->options();
+                const auto tick = std::max(std::chrono::milliseconds(10), options.max_latency / 10);
+                rxcpp::observable<>::interval(tick, coordination)
+                        .subscribe(out.get_subscription(), [=](long) {
+                            std::lock_guard<std::mutex> lock(state->mutex);
+                            if (!state->buffer.empty() && std::chrono::steady_clock::now() - state->oldest >= controller->options().max_latency) {
+                                flush();
+                            }
+                        });
+
+                source.subscribe(
+                        out.get_subscription(),
+                        [=](const T& item) {
+                            std::lock_guard<std::mutex> lock(state->mutex);
+                            if (state->buffer.empty()) {
+                                state->oldest = std::chrono::steady_clock::now();
+                            }
+                            state->buffer.push_back(item);
+                            state->bytes += bytes(item);
+                            controller->queued(1);
+                            if (state->buffer.size() >= controller->target() || state->bytes >= controller->options().max_bytes) {
+                                flush();
+                            }
+                        },
+                        [=](std::exception_ptr ep) {
+                            std::lock_guard<std::mutex> lock(state->mutex);
+                            flush();
+                            out.on_error(ep);
+                        },
+                        [=]() {
+                            std::lock_guard<std::mutex> lock(state->mutex);
+                            flush();
+                            out.on_completed();
+                        });
+            }) |
+            rxcpp::operators::observe_on(coordination);
+        };
+    }
+}
@@ -0,0 +1,210 @@
+
+// Trains a fastText model with the labelled tweets stored in the database and scores the stored tweets with
+//  it. Rows are read with a cursor and go straight into the library, there are no intermediate files.
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fasttext/trainer.h>
+#include <pqxx/pqxx>
+
+#include "classifier.h"
+#include "metrics.h"
+#include "db/tweet.h"
+
+
+namespace {
+
+    const std::string label_prefix = "__label__";
+
+    struct options {
+        std::string command;
+        std::string model;
+        std::string lang;
+        std::size_t batch = 10000;
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::string> fasttext;  // the rest, for fasttext::Args
+    };
+
+    void usage() {
+        std::cerr << "usage: retrain train <output> [-lang <lang>] [-batch <rows>] [fastText supervised options]\n"
+                  << "       retrain score <model> [-lang <lang>] [-batch <rows>] [-thread <threads>]\n\n"
+                  << "  train  trains a model with the labelled tweets, it is saved as '<output>.bin'\n"
+                  << "  score  sets label and score of the tweets with the predictions of the model\n"
+                  << "  -lang  only tweets in this language\n"
+                  << "  -batch rows read (and updated) at once [10000]\n";
+    }
+
+    options parse(int argc, char** argv) {
+        if (argc < 3) {
+            usage();
+            std::exit(EXIT_FAILURE);
+        }
+        options ret;
+        ret.command = argv[1];
+        ret.model = argv[2];
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "-lang" && has_value) ret.lang = argv[++i];
+            else if (arg == "-batch" && has_value) ret.batch = std::stoul(argv[++i]);
+            else {
+                if (arg == "-thread" && has_value) ret.threads = std::stoul(argv[i + 1]);
+                ret.fasttext.push_back(arg);
+            }
+        }
+        if ((ret.command != "train" && ret.command != "score") || (ret.command == "score" && ret.fasttext.size() > 2)) {
+            usage();
+            std::exit(EXIT_FAILURE);
+        }
+        return ret;
+    }
+
+    // The same line the pipeline classifies (see 'classifier::fasttext_line'), after the label to train
+    std::string line(const db::Tweet& tweet, bool with_label) {
+        const std::string text = classifier::fasttext_line(std::get<5>(tweet));
+        return with_label ? label_prefix + std::get<6>(tweet) + " " + text : text;
+    }
+
+    // Rows of the cursor as text in the fastText format, to build the dictionary
+    class TweetsBuffer : public std::streambuf {
+    public:
+        explicit TweetsBuffer(db::TweetCursor& cursor) : _cursor(cursor) {}
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+            _buffer.clear();
+            while (_buffer.empty() && _cursor.next(_rows)) {
+                for (auto& row: _rows) {
+                    _buffer.append(line(row, true));
+                }
+            }
+            if (_buffer.empty()) return traits_type::eof();
+            setg(&_buffer[0], &_buffer[0], &_buffer[0] + _buffer.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+        db::TweetCursor& _cursor;
+        std::vector<db::Tweet> _rows;
+        std::string _buffer;
+    };
+
+    // Calls 'f(part, begin, end)' for 'threads' parts of [0, n) in parallel
+    template <class Function>
+    void parallel_for(std::size_t n, unsigned threads, Function f) {
+        std::vector<std::future<void>> parts;
+        for (unsigned part = 0; part < threads; ++part) {
+            const std::size_t begin = n * part / threads, end = n * (part + 1) / threads;
+            parts.push_back(std::async(std::launch::async, [&f, part, begin, end]() { f(part, begin, end); }));
+        }
+        for (auto& it: parts) it.get();
+    }
+
+    fasttext::Corpus tokenize(const fasttext::Predictor& predictor, db::TweetCursor& cursor, unsigned threads) {
+        static auto& tokenized = metrics::Registry::instance().counter("retrain_tokenized_tweets_total", "Tweets tokenized to train");
+        fasttext::Corpus ret;
+        std::vector<db::Tweet> rows;
+        while (cursor.next(rows)) {
+            std::vector<fasttext::Corpus> parts(threads);
+            parallel_for(rows.size(), threads, [&](unsigned part, std::size_t begin, std::size_t end) {
+                std::vector<std::int32_t> words, labels, hashes;
+                for (std::size_t i = begin; i < end; ++i) {
+                    const std::string text = line(rows[i], true);
+                    std::int32_t ntokens = 0;
+                    predictor.getWords(text.data(), text.data() + text.size(), words, labels, hashes, &ntokens);
+                    parts[part].add(words, labels, hashes, ntokens);
+                }
+            });
+            for (auto& part: parts) ret.append(part);
+            tokenized.add(rows.size());
+        }
+        return ret;
+    }
+
+    int train(const options& options, pqxx::connection& connection) {
+        std::vector<std::string> args{"retrain", "supervised", "-input", "postgresql", "-output", options.model};
+        args.insert(args.end(), options.fasttext.begin(), options.fasttext.end());
+        fasttext::Args fasttext_args;
+        fasttext_args.parseArgs(args);
+
+        db::TweetManager tweets(connection);
+        fasttext::Trainer trainer(fasttext_args);
+        trainer.setSubwordCache(100000);
+        {
+            auto cursor = tweets.cursor(options.lang, true, options.batch);
+            TweetsBuffer buffer(*cursor);
+            std::istream in(&buffer);
+            trainer.readDictionary(in);
+        }
+        const auto dict = trainer.getDictionary();
+        std::cout << "words: " << dict->nwords() << ", labels: " << dict->nlabels() << std::endl;
+
+        fasttext::Corpus corpus;
+        {
+            auto cursor = tweets.cursor(options.lang, true, options.batch);
+            corpus = tokenize(trainer, *cursor, options.threads);
+        }
+        std::cout << "examples: " << corpus.size() << ", tokens: " << corpus.ntokens() << std::endl;
+
+        trainer.train(corpus);
+        trainer.saveModel();
+        std::cout << "loss: " << trainer.getLoss() << ", model: " << options.model << ".bin" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    int score(const options& options, pqxx::connection& reading, pqxx::connection& writing) {
+        static auto& scored = metrics::Registry::instance().counter("retrain_scored_tweets_total", "Tweets labelled again");
+
+        fasttext::Predictor predictor;
+        predictor.setSubwordCache(100000);
+        predictor.loadModel(options.model);
+        const auto dict = predictor.getDictionary();
+
+        db::TweetManager source(reading), sink(writing);
+        auto cursor = source.cursor(options.lang, false, options.batch);
+        std::vector<db::Tweet> rows;
+        std::future<void> pending;  // the update of the previous batch, while this one is scored
+        std::size_t count = 0;
+        while (cursor->next(rows)) {
+            std::vector<db::Label> labels(rows.size());
+            parallel_for(rows.size(), options.threads, [&](unsigned, std::size_t begin, std::size_t end) {
+                std::vector<std::pair<fasttext::real, std::int32_t>> predictions;
+                for (std::size_t i = begin; i < end; ++i) {
+                    predictor.predictLine(line(rows[i], false), 1, predictions);
+                    std::string label = predictions.empty() ? std::string{} : dict->getLabel(predictions[0].second);
+                    if (label.compare(0, label_prefix.size(), label_prefix) == 0) label.erase(0, label_prefix.size());
+                    labels[i] = db::Label{std::get<1>(rows[i]), label, predictions.empty() ? 0.f : predictions[0].first};
+                }
+            });
+            if (pending.valid()) pending.get();
+            pending = std::async(std::launch::async, [&sink, labels = std::move(labels)]() { sink.update(labels); });
+            count += rows.size();
+            scored.add(rows.size());
+        }
+        if (pending.valid()) pending.get();
+        std::cout << "scored: " << count << std::endl;
+        return EXIT_SUCCESS;
+    }
+}
+
+
+int main(int argc, char** argv) {
+    const auto options = parse(argc, argv);
+    try {
+        // connection parameters from the environment (PGHOST, PGDATABASE, PGUSER,...), the cursor keeps a
+        //  transaction open on the first one so the updates go through the second one
+        pqxx::connection reading;
+        if (options.command == "train") return train(options, reading);
+        pqxx::connection writing;
+        return score(options, reading, writing);
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -1,6 +1,8 @@
 
 #include "rxcurl.h"
 
+#include "metrics.h"
+
 namespace rxcurl {
 
     rxcurl create_rxcurl() {
@@ -8,8 +10,21 @@ namespace rxcurl {
         return r;
     };
 
+    namespace {
+        std::uint64_t nanoseconds(double seconds) {
+            return static_cast<std::uint64_t>(seconds * 1e9);
+        }
+    }
+
     size_t rxcurlhttpCallback(char* ptr, size_t size, size_t nmemb, rxcpp::subscriber<std::string>* out) {
+        static auto& chunks = metrics::Registry::instance().counter("rxcurl_chunks_total", "Chunks received by curl");
+        static auto& bytes = metrics::Registry::instance().counter("rxcurl_received_bytes_total", "Bytes received by curl");
+        static auto& latency = metrics::Registry::instance().histogram("rxcurl_chunk_seconds", "Time to hand a chunk over to the pipeline");
+        metrics::Timer timer{latency};
+
         int iRealSize = size * nmemb;
+        chunks.add();
+        bytes.add(iRealSize);
 
         std::string chunk;
         chunk.assign(ptr, iRealSize);
@@ -174,6 +189,9 @@ namespace rxcurl {
 
                         r.state->curl = curl;
                         curl_multi_add_handle(localState->curlm, curl);
+
+                        static auto& requests = metrics::Registry::instance().counter("rxcurl_requests_total", "Requests started");
+                        requests.add();
                     })
                     .subscribe();
 
@@ -201,6 +219,18 @@ namespace rxcurl {
                         curl_easy_getinfo(rs->curl, CURLINFO_RESPONSE_CODE, &httpStatus);
                         rs->httpStatus = httpStatus;
 
+                        static auto& failures = metrics::Registry::instance().counter("rxcurl_failed_requests_total", "Requests finished with an error");
+                        static auto& namelookup = metrics::Registry::instance().histogram("rxcurl_namelookup_seconds", "Time until name resolution completed");
+                        static auto& connect = metrics::Registry::instance().histogram("rxcurl_connect_seconds", "Time until the connection was established");
+                        static auto& appconnect = metrics::Registry::instance().histogram("rxcurl_appconnect_seconds", "Time until the TLS handshake completed");
+                        static auto& total = metrics::Registry::instance().histogram("rxcurl_request_seconds", "Total duration of the requests");
+                        double seconds = 0.0;
+                        if (curl_easy_getinfo(rs->curl, CURLINFO_NAMELOOKUP_TIME, &seconds) == CURLE_OK) namelookup.record(nanoseconds(seconds));
+                        if (curl_easy_getinfo(rs->curl, CURLINFO_CONNECT_TIME, &seconds) == CURLE_OK) connect.record(nanoseconds(seconds));
+                        if (curl_easy_getinfo(rs->curl, CURLINFO_APPCONNECT_TIME, &seconds) == CURLE_OK) appconnect.record(nanoseconds(seconds));
+                        if (curl_easy_getinfo(rs->curl, CURLINFO_TOTAL_TIME, &seconds) == CURLE_OK) total.record(nanoseconds(seconds));
+                        if (message->data.result != CURLE_OK || httpStatus > 499) failures.add();
+
                         if(message->data.result != CURLE_OK) {
                             rs->code = message->data.result;
                             if (rs->error.empty()) {
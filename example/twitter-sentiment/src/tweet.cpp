@@ -4,7 +4,9 @@
 #include <sstream>
 #include <iomanip>
 #include <iostream>
-#include "utils.h"
+
+#include "lru.h"
+#include "metrics.h"
 
 namespace twitter {
 
@@ -21,6 +23,47 @@ namespace twitter {
         return {};
     }
 
+    std::string retweetedid(const nlohmann::json& tweet) {
+        auto it = tweet.find("retweeted_status");
+        if (it != tweet.end() && it->is_object() && it->count("id_str") && (*it)["id_str"].is_string()) {
+            return (*it)["id_str"];
+        }
+        return {};
+    }
+
+    namespace {
+        struct tokenized {
+            std::vector<words::word_id> words;
+            std::vector<words::word_id> tokens;
+        };
+
+        tokenized tokenize(const std::string& text) {
+            static auto& latency = metrics::Registry::instance().histogram("twitter_tokenize_seconds", "Time to split a tweet in words");
+            metrics::Timer timer{latency};
+            return tokenized{words::splitwords(text), words::fasttext_tokens(text)};
+        }
+
+        // Retweets have the same words as the original tweet, tokenize it only once
+        tokenized tokenize_tweet(const nlohmann::json& tweet) {
+            static auto& reused = metrics::Registry::instance().counter("twitter_tokenize_retweets_total", "Retweets that reused the words of the original tweet");
+            static utils::LruCache<std::string, tokenized> retweets(100000);
+
+            const std::string id_str = retweetedid(tweet);
+            if (id_str.empty()) {
+                return tokenize(tweettext(tweet));
+            }
+
+            tokenized ret;
+            if (retweets.get(id_str, ret)) {
+                reused.add();
+                return ret;
+            }
+            ret = tokenize(tweettext(tweet));
+            retweets.put(id_str, ret);
+            return ret;
+        }
+    }
+
     Tweet::Tweet() {}
     Tweet::Tweet(const nlohmann::json& tweet)
             : data(std::make_shared<shared>(shared{tweet}))
@@ -29,8 +72,11 @@ namespace twitter {
     Tweet::shared::shared() {}
     Tweet::shared::shared(const nlohmann::json& t)
             : tweet(t)
-            , words(utils::splitwords(tweettext(tweet)))
-    {}
+    {
+        auto ids = tokenize_tweet(tweet);
+        words = std::move(ids.words);
+        tokens = std::move(ids.tokens);
+    }
 
 
     std::string Tweet::id_str() const {
@@ -76,4 +122,8 @@ namespace twitter {
         return ret;
     }
 
+    std::string Tweet::retweeted_id() const {
+        return retweetedid(this->data->tweet);
+    }
+
 }
\ No newline at end of file
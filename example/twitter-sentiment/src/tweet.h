@@ -4,10 +4,14 @@
 #include <string>
 #include <nlohmann/json.hpp>
 
+#include "words.h"
+
 
 namespace twitter {
 
     std::string tweettext(const nlohmann::json& tweet);
+    // Id of the tweet retweeted by 'tweet', or an empty string if it is not a retweet
+    std::string retweetedid(const nlohmann::json& tweet);
 
     struct Tweet
     {
@@ -20,13 +24,17 @@ namespace twitter {
         std::string text() const;
         time_t timestamp() const;
         std::vector<std::string> hashtags() const;
+        std::string retweeted_id() const;
 
         struct shared
         {
             shared();
             explicit shared(const nlohmann::json& t);
             nlohmann::json tweet;
-            std::vector<std::string> words;
+            // interned ids (see 'words::Interner') of the words in the text, as 'words::splitwords'
+            std::vector<words::word_id> words;
+            // and of the tokens a fastText model reads, as 'words::fasttext_tokens'
+            std::vector<words::word_id> tokens;
         };
         std::shared_ptr<const shared> data = std::make_shared<shared>();
     };
@@ -3,6 +3,7 @@
 
 #include <oauth.h>
 #include "utils.h"
+#include "metrics.h"
 
 
 namespace twitter {
@@ -19,6 +20,8 @@ namespace twitter {
                    // https://dev.twitter.com/streaming/overview/connecting
                    rxcpp::operators::timeout(std::chrono::seconds(90), tweetthread) |
                    rxcpp::operators::on_error_resume_next([=](std::exception_ptr ep) -> rxcpp::observable<std::string> {
+                       static auto& errors = metrics::Registry::instance().counter("twitter_stream_errors_total", "Errors in the stream connection");
+                       errors.add();
                        try {rethrow_exception(ep);}
                        catch (const rxcurl::http_exception& ex) {
                            std::cerr << ex.what() << std::endl;
@@ -99,12 +102,14 @@ namespace twitter {
         return *it0 == '\r' && *it1 == '\n';
     };
 
-    auto parsetweets(rxcpp::observe_on_one_worker worker, rxcpp::observe_on_one_worker tweetthread) -> std::function<rxcpp::observable<parsedtweets>(rxcpp::observable<std::string>)> {
+    auto parsetweets(pipeline::queue_options<std::string> lines, rxcpp::observe_on_one_worker tweetthread) -> std::function<rxcpp::observable<parsedtweets>(rxcpp::observable<std::string>)> {
         return [=](rxcpp::observable<std::string> chunks) -> rxcpp::observable<parsedtweets> {
             return rxcpp::rxs::create<parsedtweets>([=](rxcpp::subscriber<parsedtweets> out){
                 // create strings split on \r
                 auto strings = chunks |
                                rxcpp::operators::concat_map([](const std::string& s){
+                                   static auto& framing = metrics::Registry::instance().histogram("twitter_framing_seconds", "Time to split a chunk in lines");
+                                   metrics::Timer timer{framing};
                                    auto splits = utils::split(s, "\r\n");
                                    return rxcpp::sources::iterate(move(splits));
                                }) |
@@ -124,27 +129,37 @@ namespace twitter {
                                    window_toggle(closes | rxcpp::operators::start_with(0), [=](int){return closes;});
 
                 // reduce the strings for a line into one string
-                auto lines = linewindows |
+                auto joined = linewindows |
                              rxcpp::operators::flat_map([](const rxcpp::observable<std::string>& w) {
                                  return w | rxcpp::operators::start_with<std::string>("") | rxcpp::operators::sum();
                              });
 
                 int count = 0;
                 rxcpp::rxsub::subject<parseerror> errorconduit;
-                rxcpp::observable<Tweet> tweets = lines |
+                rxcpp::observable<Tweet> tweets = joined |
                                                   rxcpp::operators::filter([](const std::string& s){
+                                                      static auto& received = metrics::Registry::instance().counter("twitter_lines_total", "Lines received from the stream");
+                                                      received.add();
                                                       return s.size() > 2 && s.find_first_not_of("\r\n") != std::string::npos;
                                                   }) |
                                                   rxcpp::operators::group_by([count](const std::string&) mutable -> int {
                                                       return ++count % std::thread::hardware_concurrency();}) |
                                                   rxcpp::rxo::map([=](rxcpp::observable<std::string> shard) {
+                                                      // if parsing falls behind, framing waits (and so does the connection)
                                                       return shard |
-                                                             rxcpp::operators::observe_on(worker) |
+                                                             pipeline::bounded(std::make_shared<pipeline::bounded_queue<std::string>>(lines)) |
                                                              rxcpp::rxo::map([=](const std::string& line) -> rxcpp::observable<Tweet> {
+                                                                 static auto& parse = metrics::Registry::instance().histogram("twitter_parse_seconds", "Time to parse the JSON of a tweet");
+                                                                 static auto& errors = metrics::Registry::instance().counter("twitter_parse_errors_total", "Lines that are not valid JSON");
                                                                  try {
-                                                                     auto tweet = nlohmann::json::parse(line);
+                                                                     nlohmann::json tweet;
+                                                                     {
+                                                                         metrics::Timer timer{parse};
+                                                                         tweet = nlohmann::json::parse(line);
+                                                                     }
                                                                      return rxcpp::rxs::from(Tweet(tweet));
                                                                  } catch (...) {
+                                                                     errors.add();
                                                                      errorconduit.get_subscriber().on_next(parseerror{std::current_exception()});
                                                                  }
                                                                  return rxcpp::rxs::empty<Tweet>();
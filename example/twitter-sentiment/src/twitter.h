@@ -7,6 +7,7 @@
 
 #include "rxcurl.h"
 #include "tweet.h"
+#include "pipeline/backpressure.h"
 
 
 namespace twitter {
@@ -23,7 +24,9 @@ namespace twitter {
         rxcpp::observable<parseerror> errors;
     };
 
-    auto parsetweets(rxcpp::observe_on_one_worker worker, rxcpp::observe_on_one_worker tweetthread) -> std::function<rxcpp::observable<parsedtweets>(rxcpp::observable<std::string>)>;
+    // Lines are parsed in one thread per core, each one fed by its own bounded queue built with 'lines'
+    //  (the 'Spill' policy doesn't make sense here: all the queues would share the same file)
+    auto parsetweets(pipeline::queue_options<std::string> lines, rxcpp::observe_on_one_worker tweetthread) -> std::function<rxcpp::observable<parsedtweets>(rxcpp::observable<std::string>)>;
 
     auto onlytweets() -> std::function<rxcpp::observable<Tweet>(rxcpp::observable<Tweet>)>;
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 
 #include "utils.h"
 
+#include <cctype>
+#include <iterator>
 #include <regex>
 #include <unordered_set>
 
@@ -22,7 +24,17 @@ namespace utils {
     }
 
     std::vector<std::string> splitwords(const std::string& text) {
+        std::vector<std::string> words;
+        foreachword(text, [&words](const std::string& word) { words.push_back(word); });
 
+        words |=
+                ranges::action::sort |
+                ranges::action::unique;
+
+        return words;
+    }
+
+    void foreachword(std::string_view text, const std::function<void(const std::string&)>& f) {
         static const std::unordered_set<std::string> ignoredWords{
                 // added
                 "rt", "like", "just", "tomorrow", "new", "year", "month", "day", "today", "make", "let", "want", "did", "going", "good", "really", "know", "people", "got", "life", "need", "say", "doing", "great", "right", "time", "best", "happy", "stop", "think", "world", "watch", "gonna", "remember", "way",
@@ -32,35 +44,45 @@ namespace utils {
                 // http://xpo6.com/list-of-english-stop-words/
                 "a", "about", "above", "above", "across", "after", "afterwards", "again", "against", "all", "almost", "alone", "along", "already", "also","although","always","am","among", "amongst", "amoungst", "amount",  "an", "and", "another", "any","anyhow","anyone","anything","anyway", "anywhere", "are", "around", "as",  "at", "back","be","became", "because","become","becomes", "becoming", "been", "before", "beforehand", "behind", "being", "below", "beside", "besides", "between", "beyond", "bill", "both", "bottom","but", "by", "call", "can", "cannot", "cant", "co", "con", "could", "couldnt", "cry", "de", "describe", "detail", "do", "done", "down", "due", "during", "each", "eg", "eight", "either", "eleven","else", "elsewhere", "empty", "enough", "etc", "even", "ever", "every", "everyone", "everything", "everywhere", "except", "few", "fifteen", "fify", "fill", "find", "fire", "first", "five", "for", "former", "formerly", "forty", "found", "four", "from", "front", "full", "further", "get", "give", "go", "had", "has", "hasnt", "have", "he", "hence", "her", "here", "hereafter", "hereby", "herein", "hereupon", "hers", "herself", "him", "himself", "his", "how", "however", "hundred", "ie", "if", "in", "inc", "indeed", "interest", "into", "is", "it", "its", "itself", "keep", "last", "latter", "latterly", "least", "less", "ltd", "made", "many", "may", "me", "meanwhile", "might", "mill", "mine", "more", "moreover", "most", "mostly", "move", "much", "must", "my", "myself", "name", "namely", "neither", "never", "nevertheless", "next", "nine", "no", "nobody", "none", "noone", "nor", "not", "nothing", "now", "nowhere", "of", "off", "often", "on", "once", "one", "only", "onto", "or", "other", "others", "otherwise", "our", "ours", "ourselves", "out", "over", "own","part", "per", "perhaps", "please", "put", "rather", "re", "same", "see", "seem", "seemed", "seeming", "seems", "serious", "several", "she", "should", "show", "side", "since", "sincere", "six", "sixty", "so", "some", "somehow", "someone", "something", "sometime", "sometimes", "somewhere", "still", "such", "system", "take", "ten", "than", "that", "the", "their", "them", "themselves", "then", "thence", "there", "thereafter", "thereby", "therefore", "therein", "thereupon", "these", "they", "thickv", "thin", "third", "this", "those", "though", "three", "through", "throughout", "thru", "thus", "to", "together", "too", "top", "toward", "towards", "twelve", "twenty", "two", "un", "under", "until", "up", "upon", "us", "very", "via", "was", "we", "well", "were", "what", "whatever", "when", "whence", "whenever", "where", "whereafter", "whereas", "whereby", "wherein", "whereupon", "wherever", "whether", "which", "while", "whither", "who", "whoever", "whole", "whom", "whose", "why", "will", "with", "within", "without", "would", "yet", "you", "your", "yours", "yourself", "yourselves", "the"};
 
-        static const std::string delimiters = R"(\s+)";
-        auto words = split(text, delimiters, Split::RemoveDelimiter);
-
         // exclude entities, urls and some punct from this words list
-
         static const std::regex ignore(R"((\xe2\x80\xa6)|(&[\w]+;)|((http|ftp|https)://[\w-]+(.[\w-]+)+([\w.,@?^=%&:/~+#-]*[\w@?^=%&/~+#-])?))");
         static const std::regex expletives(R"(\x66\x75\x63\x6B|\x73\x68\x69\x74|\x64\x61\x6D\x6E)");
 
-        for (auto& word: words) {
-            while (!word.empty() && (word.front() == '.' || word.front() == '(' || word.front() == '\'' || word.front() == '\"')) word.erase(word.begin());
-            while (!word.empty() && (word.back() == ':' || word.back() == ',' || word.back() == ')' || word.back() == '\'' || word.back() == '\"')) word.resize(word.size() - 1);
-            if (!word.empty() && word.front() == '@') continue;
-            word = regex_replace(tolower(word), ignore, "");
-            if (!word.empty() && word.front() != '#') {
-                while (!word.empty() && ispunct(word.front())) word.erase(word.begin());
-                while (!word.empty() && ispunct(word.back())) word.resize(word.size() - 1);
+        // reused for every word, only the words kept are copied (by 'f')
+        thread_local std::string lower, word;
+        auto is_space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+        for (std::size_t end = 0; end < text.size();) {
+            const std::size_t begin = end;
+            while (end < text.size() && !is_space(text[end])) ++end;
+            std::string_view token = text.substr(begin, end - begin);
+            while (end < text.size() && is_space(text[end])) ++end;
+
+            while (!token.empty() && (token.front() == '.' || token.front() == '(' || token.front() == '\'' || token.front() == '\"')) token.remove_prefix(1);
+            while (!token.empty() && (token.back() == ':' || token.back() == ',' || token.back() == ')' || token.back() == '\'' || token.back() == '\"')) token.remove_suffix(1);
+            if (!token.empty() && token.front() == '@') {
+                word.assign(token.data(), token.size());
+            } else {
+                lower.assign(token.data(), token.size());
+                transform(lower.begin(), lower.end(), lower.begin(), [=](char c){return std::tolower(c);});
+                word.clear();
+                std::regex_replace(std::back_inserter(word), lower.begin(), lower.end(), ignore, "");
+                if (!word.empty() && word.front() != '#') {
+                    std::size_t first = 0, last = word.size();
+                    while (first < last && ispunct(word[first])) ++first;
+                    while (last > first && ispunct(word[last - 1])) --last;
+                    word.erase(last).erase(0, first);
+                }
+                if (std::regex_search(word, expletives)) {
+                    lower.clear();
+                    std::regex_replace(std::back_inserter(lower), word.begin(), word.end(), expletives, "<expletive>");
+                    word.swap(lower);
+                }
             }
-            word = regex_replace(word, expletives, "<expletive>");
-        }
-
-        words.erase(std::remove_if(words.begin(), words.end(), [=](const std::string& w){
-            return !(w.size() > 2 && ignoredWords.find(w) == ignoredWords.end());
-        }), words.end());
 
-        words |=
-                ranges::action::sort |
-                ranges::action::unique;
-
-        return words;
+            if (word.size() > 2 && ignoredWords.find(word) == ignoredWords.end()) {
+                f(word);
+            }
+        }
     }
 
 }
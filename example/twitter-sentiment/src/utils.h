@@ -1,7 +1,9 @@
 
 #pragma once
 
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
@@ -17,5 +19,10 @@ namespace utils {
 
     std::string tolower(std::string s);
 
+    // Words of the text (lower case, without urls, html entities, punctuation nor stop words; mentions are
+    //  kept as they are), sorted and without duplicates
     std::vector<std::string> splitwords(const std::string& text);
+    // Calls 'f' with every word 'splitwords' keeps, in the order they are in the text (duplicates
+    //  included). The string is a buffer reused for the next word, no copy is made unless 'f' makes it.
+    void foreachword(std::string_view text, const std::function<void(const std::string&)>& f);
 }
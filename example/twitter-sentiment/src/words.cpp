@@ -0,0 +1,196 @@
+
+#include "words.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "metrics.h"
+#include "utils.h"
+
+namespace words {
+
+    struct Interner::Entry {
+        std::uint64_t hash;
+        word_id id;
+        std::string word;
+    };
+
+    struct Interner::Table {
+        explicit Table(std::size_t capacity) : mask(capacity - 1), slots(new std::atomic<const Entry*>[capacity]) {
+            for (std::size_t i = 0; i < capacity; ++i) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // Only called holding the shard lock, readers may be probing the table at the same time
+        void insert(const Entry* entry) {
+            auto i = entry->hash & mask;
+            while (slots[i].load(std::memory_order_relaxed) != nullptr) {
+                i = (i + 1) & mask;
+            }
+            slots[i].store(entry, std::memory_order_release);
+        }
+
+        const Entry* find(std::uint64_t hash, std::string_view word) const {
+            for (auto i = hash & mask;; i = (i + 1) & mask) {
+                const Entry* entry = slots[i].load(std::memory_order_acquire);
+                if (entry == nullptr) return nullptr;
+                if (entry->hash == hash && entry->word == word) return entry;
+            }
+        }
+
+        const std::size_t mask;
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    };
+
+    struct Interner::Shard {
+        Shard() : table(nullptr) {
+            tables.emplace_back(std::make_unique<Table>(1024));
+            table.store(tables.back().get());
+        }
+
+        std::mutex mutex;
+        std::atomic<Table*> table;
+        std::size_t count = 0;
+        // Old tables are kept alive because lock-free readers may still be probing them
+        std::vector<std::unique_ptr<Table>> tables;
+        std::vector<std::unique_ptr<Entry>> entries;
+    };
+
+    namespace {
+        std::uint64_t hash(std::string_view word) {
+            return std::hash<std::string_view>{}(word);
+        }
+    }
+
+    Interner& Interner::instance() {
+        static Interner instance;
+        return instance;
+    }
+
+    Interner::Interner(std::size_t capacity)
+            : _shards(new Shard[std::size_t(1) << shard_bits])
+            , _capacity(std::min<std::size_t>(capacity, overflow))
+            , _next_id(0)
+    {
+        for (auto& chunk: _chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    Interner::~Interner() {
+        for (auto& chunk: _chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    word_id Interner::intern(std::string_view word) {
+        const auto h = hash(word);
+        Shard& shard = _shards[h >> (64 - shard_bits)];
+        if (const Entry* entry = shard.table.load(std::memory_order_acquire)->find(h, word)) {
+            return entry->id;
+        }
+        return insert(shard, h, word);
+    }
+
+    word_id Interner::find(std::string_view word) const {
+        const auto h = hash(word);
+        const Shard& shard = _shards[h >> (64 - shard_bits)];
+        const Entry* entry = shard.table.load(std::memory_order_acquire)->find(h, word);
+        return entry ? entry->id : npos;
+    }
+
+    std::string_view Interner::word(word_id id) const {
+        auto chunk = _chunks[id >> chunk_bits].load(std::memory_order_acquire);
+        if (chunk == nullptr) {
+            throw std::out_of_range("Unknown word id");
+        }
+        const Entry* entry = chunk[id & (chunk_size - 1)].load(std::memory_order_acquire);
+        if (entry == nullptr) {
+            throw std::out_of_range("Unknown word id");
+        }
+        return entry->word;
+    }
+
+    std::size_t Interner::size() const {
+        return _next_id.load(std::memory_order_acquire);
+    }
+
+    std::size_t Interner::capacity() const {
+        return _capacity;
+    }
+
+    word_id Interner::insert(Shard& shard, std::uint64_t hash, std::string_view word) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Table* current = shard.table.load(std::memory_order_relaxed);
+        if (const Entry* entry = current->find(hash, word)) {
+            return entry->id;  // another thread interned it while we were waiting for the lock
+        }
+
+        word_id id = _next_id.load(std::memory_order_relaxed);
+        do {
+            if (id >= _capacity) {
+                static auto& full = metrics::Registry::instance().counter("words_interner_full_total", "Words not interned because the table is full");
+                full.add();
+                const word_id ret = overflow | static_cast<word_id>(hash & (overflow - 1));
+                return ret == npos ? ret - 1 : ret;
+            }
+        } while (!_next_id.compare_exchange_weak(id, id + 1, std::memory_order_acq_rel));
+        shard.entries.emplace_back(new Entry{hash, id, std::string{word}});
+        const Entry* entry = shard.entries.back().get();
+        // Make the id resolvable before the word can be found in the table
+        publish(entry);
+
+        if (2 * (shard.count + 1) > current->mask + 1) {
+            auto grown = std::make_unique<Table>(2 * (current->mask + 1));
+            for (auto& it: shard.entries) {
+                grown->insert(it.get());
+            }
+            shard.table.store(grown.get(), std::memory_order_release);
+            shard.tables.emplace_back(std::move(grown));
+        } else {
+            current->insert(entry);
+        }
+        ++shard.count;
+        return id;
+    }
+
+    void Interner::publish(const Entry* entry) {
+        auto& slot = _chunks[entry->id >> chunk_bits];
+        auto chunk = slot.load(std::memory_order_acquire);
+        if (chunk == nullptr) {
+            std::lock_guard<std::mutex> lock(_chunks_mutex);
+            chunk = slot.load(std::memory_order_acquire);
+            if (chunk == nullptr) {
+                chunk = new std::atomic<const Entry*>[chunk_size];
+                for (std::size_t i = 0; i < chunk_size; ++i) {
+                    chunk[i].store(nullptr, std::memory_order_relaxed);
+                }
+                slot.store(chunk, std::memory_order_release);
+            }
+        }
+        chunk[entry->id & (chunk_size - 1)].store(entry, std::memory_order_release);
+    }
+
+    std::vector<word_id> splitwords(std::string_view text, Interner& interner) {
+        std::vector<word_id> ids;
+        utils::foreachword(text, [&](const std::string& word) { ids.push_back(interner.intern(word)); });
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+
+    std::vector<word_id> fasttext_tokens(std::string_view text, Interner& interner) {
+        // same separators as 'fasttext::Dictionary::readWord', new lines included (they are spaces in a line)
+        auto separator = [](char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f' || c == '\0'; };
+        std::vector<word_id> ids;
+        for (std::size_t end = 0; end < text.size();) {
+            while (end < text.size() && separator(text[end])) ++end;
+            const std::size_t begin = end;
+            while (end < text.size() && !separator(text[end])) ++end;
+            if (end > begin) ids.push_back(interner.intern(text.substr(begin, end - begin)));
+        }
+        ids.push_back(interner.intern(eos));
+        return ids;
+    }
+}
@@ -0,0 +1,78 @@
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace words {
+
+    typedef std::uint32_t word_id;
+
+    // Concurrent string interning table: maps every token to a stable 32-bit id once, so the rest of
+    //  the pipeline can work with ids instead of hashing and copying strings again and again.
+    //  Lookups never take a lock, insertions only lock the shard the word belongs to.
+    //
+    //  Words are never removed (ids must stay valid), so the table stops growing at 'capacity' words:
+    //  after that, new words get an id computed from their hash, above 'overflow'. Those ids can still
+    //  be compared (two different words may get the same one, rarely) but 'word' can't resolve them.
+    class Interner {
+    public:
+        static constexpr word_id npos = std::numeric_limits<word_id>::max();
+        static constexpr word_id overflow = word_id(1) << 31;
+        static constexpr std::size_t default_capacity = std::size_t(1) << 22;
+
+        static Interner& instance();
+
+        explicit Interner(std::size_t capacity = default_capacity);
+        ~Interner();
+        Interner(const Interner&) = delete;
+        Interner& operator=(const Interner&) = delete;
+
+        // Returns the id of the word, interning it if it is not already known (and there is room)
+        word_id intern(std::string_view word);
+        // Returns the id of the word or 'npos' if it is unknown (it never blocks)
+        word_id find(std::string_view word) const;
+        // Returns the word for a given id, the view is valid as long as the interner is alive
+        std::string_view word(word_id id) const;
+
+        std::size_t size() const;
+        std::size_t capacity() const;
+
+    protected:
+        struct Entry;
+        struct Table;
+        struct Shard;
+
+        static constexpr std::size_t shard_bits = 6;
+        static constexpr std::size_t chunk_bits = 16;
+        static constexpr std::size_t chunk_size = std::size_t(1) << chunk_bits;
+
+        word_id insert(Shard& shard, std::uint64_t hash, std::string_view word);
+        void publish(const Entry* entry);
+
+        std::unique_ptr<Shard[]> _shards;
+        std::array<std::atomic<std::atomic<const Entry*>*>, (std::size_t(1) << (32 - chunk_bits))> _chunks;
+        std::mutex _chunks_mutex;
+        const std::size_t _capacity;
+        std::atomic<word_id> _next_id;
+    };
+
+    // Same tokenization as 'utils::splitwords' (sorted by id instead of by word), but returns the interned
+    //  ids of the words without making a string for each one
+    std::vector<word_id> splitwords(std::string_view text, Interner& interner = Interner::instance());
+
+    // End of line token of fastText ('fasttext::Dictionary::EOS')
+    constexpr std::string_view eos = "</s>";
+
+    // Tokens of the text as 'fasttext predict' reads them (split at white space, the whole text is one line
+    //  ending in 'eos'), interned so a model can map every token to its ids only once (see 'classifier::Model')
+    std::vector<word_id> fasttext_tokens(std::string_view text, Interner& interner = Interner::instance());
+}
@@ -0,0 +1,192 @@
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "check.h"
+#include "tweet.h"
+#include "pipeline/backpressure.h"
+
+// Pushes tweets as fast as possible into a bounded queue read by a slow sink, and checks that the
+//  queue (and the memory of the process) stays bounded whatever the policy is.
+
+namespace {
+
+    const std::size_t tweets = 4000;
+    const std::size_t capacity = 64;
+    const std::size_t text_size = 16 * 1024;  // all the tweets together are ~64MB
+    const std::size_t max_rss_growth = 16 * 1024 * 1024;
+    const char* spill_path = "test_backpressure.spill";
+
+    std::size_t rss() {
+        std::size_t pages = 0, resident = 0;
+        if (std::FILE* statm = std::fopen("/proc/self/statm", "r")) {
+            if (std::fscanf(statm, "%zu %zu", &pages, &resident) != 2) resident = 0;
+            std::fclose(statm);
+        }
+        return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    twitter::Tweet make_tweet(std::size_t i) {
+        nlohmann::json tweet;
+        tweet["id_str"] = std::to_string(i);
+        tweet["timestamp_ms"] = std::to_string(1526140800000 + i);
+        tweet["lang"] = "en";
+        tweet["text"] = std::string(text_size, 'a' + i % 26);
+        // retweets of the same tweet are tokenized once, so the producer is fast enough to overflow the queue
+        tweet["retweeted_status"]["id_str"] = "1";
+        return twitter::Tweet(tweet);
+    }
+
+    pipeline::queue_options<twitter::Tweet> options(pipeline::overflow policy) {
+        pipeline::queue_options<twitter::Tweet> options;
+        options.capacity = capacity;
+        options.policy = policy;
+        options.spill_path = spill_path;
+        options.encode = [](const twitter::Tweet& tw) { return tw.data->tweet.dump(); };
+        options.decode = [](const std::string& record) { return twitter::Tweet(nlohmann::json::parse(record)); };
+        return options;
+    }
+
+    struct result {
+        std::vector<std::size_t> received;  // ids in the order the sink got them
+        std::size_t max_size = 0;
+        std::size_t rss_growth = 0;
+    };
+
+    result run(pipeline::bounded_queue<twitter::Tweet>& queue) {
+        result ret;
+        const auto baseline = rss();
+        std::thread sink([&]() {
+            twitter::Tweet tw;
+            while (queue.pop(tw)) {
+                ret.received.push_back(std::stoull(tw.id_str()));
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+        for (std::size_t i = 0; i < tweets; ++i) {
+            CHECK(queue.push(make_tweet(i)));
+            ret.max_size = std::max(ret.max_size, queue.size());
+            if (i % 100 == 0) {
+                const auto current = rss();
+                ret.rss_growth = std::max(ret.rss_growth, current > baseline ? current - baseline : 0);
+            }
+        }
+        queue.close();
+        sink.join();
+        return ret;
+    }
+
+    bool in_order(const std::vector<std::size_t>& ids) {
+        for (std::size_t i = 1; i < ids.size(); ++i) {
+            if (ids[i] <= ids[i - 1]) return false;
+        }
+        return true;
+    }
+
+    void block() {
+        pipeline::bounded_queue<twitter::Tweet> queue(options(pipeline::overflow::Block));
+        auto r = run(queue);
+        CHECK(r.max_size <= capacity);
+        CHECK(queue.dropped() == 0);
+        CHECK(r.received.size() == tweets);
+        CHECK(in_order(r.received));
+        CHECK(r.rss_growth < max_rss_growth);
+    }
+
+    void drop_oldest() {
+        pipeline::bounded_queue<twitter::Tweet> queue(options(pipeline::overflow::DropOldest));
+        auto r = run(queue);
+        CHECK(r.max_size <= capacity);
+        CHECK(queue.dropped() > 0);
+        CHECK(r.received.size() + queue.dropped() == tweets);
+        CHECK(in_order(r.received));
+        CHECK(r.received.back() == tweets - 1);  // the newest ones are never dropped
+        CHECK(r.rss_growth < max_rss_growth);
+    }
+
+    void spill() {
+        std::remove(spill_path);
+        {
+            pipeline::bounded_queue<twitter::Tweet> queue(options(pipeline::overflow::Spill));
+            auto r = run(queue);
+            CHECK(r.max_size <= capacity);
+            CHECK(queue.dropped() == 0);
+            CHECK(queue.spilled() > 0);
+            CHECK(queue.replayed() == queue.spilled());
+            CHECK(r.received.size() == tweets);
+            CHECK(in_order(r.received));
+            CHECK(r.rss_growth < max_rss_growth);
+        }
+        CHECK(::access(spill_path, F_OK) != 0);  // removed once everything has been replayed
+    }
+
+    // Same as 'block' through the rx operator: the source is read from the thread that subscribes and
+    //  the items are delivered from the consumer thread, in order and without losing any
+    void bounded_operator() {
+        auto queue = std::make_shared<pipeline::bounded_queue<twitter::Tweet>>(options(pipeline::overflow::Block));
+        std::vector<std::size_t> received;
+        std::size_t max_size = 0;
+        auto source = rxcpp::observable<>::range<std::size_t>(0, tweets - 1) |
+                      rxcpp::rxo::map([](std::size_t i) { return make_tweet(i); }) |
+                      rxcpp::rxo::as_dynamic();
+        (source | pipeline::bounded(queue)).as_blocking().subscribe([&](const twitter::Tweet& tw) {
+            received.push_back(std::stoull(tw.id_str()));
+            max_size = std::max(max_size, queue->size());
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        });
+        CHECK(max_size <= capacity);
+        CHECK(queue->dropped() == 0);
+        CHECK(received.size() == tweets);
+        CHECK(in_order(received));
+    }
+
+    void spill_restart() {
+        std::remove(spill_path);
+        {
+            // nobody reads: the first items stay in memory (and are lost), the rest go to the file
+            pipeline::bounded_queue<twitter::Tweet> queue(options(pipeline::overflow::Spill));
+            for (std::size_t i = 0; i < 2 * capacity; ++i) {
+                CHECK(queue.push(make_tweet(i)));
+            }
+            CHECK(queue.spilled() == capacity);
+        }
+        {
+            // a record half written by a crash is discarded
+            std::FILE* file = std::fopen(spill_path, "ab");
+            CHECK(file != nullptr);
+            const std::uint32_t size = 1000;
+            std::fwrite(&size, sizeof(size), 1, file);
+            std::fwrite("{\"id_str\"", 1, 9, file);
+            std::fclose(file);
+        }
+        pipeline::bounded_queue<twitter::Tweet> queue(options(pipeline::overflow::Spill));
+        queue.close();
+        std::vector<std::size_t> received;
+        twitter::Tweet tw;
+        while (queue.pop(tw)) {
+            received.push_back(std::stoull(tw.id_str()));
+        }
+        CHECK(received.size() == capacity);
+        CHECK(received.front() == capacity);
+        CHECK(in_order(received));
+    }
+}
+
+int main() {
+    block();
+    drop_oldest();
+    spill();
+    spill_restart();
+    bounded_operator();
+    std::remove(spill_path);
+    std::cout << "backpressure: ok" << std::endl;
+    return 0;
+}
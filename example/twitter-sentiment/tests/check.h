@@ -0,0 +1,9 @@
+
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+// Stops the test (with the failed condition and where it is) if 'condition' doesn't hold
+#define CHECK(condition) \
+    if (!(condition)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; std::exit(1); }
@@ -0,0 +1,165 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "metrics.h"
+#include "db/columnar.h"
+
+// Writes tweets to a columnar file and reads them back: whole, by time range and with predicates on the
+//  dictionary encoded columns, after a crash in the middle of a chunk and over a file that is not ours.
+
+namespace {
+
+    const char* path = "test_columnar.col";
+    const time_t start = 1526140800;
+
+    std::size_t file_size() {
+        struct stat st{};
+        CHECK(::stat(path, &st) == 0);
+        return static_cast<std::size_t>(st.st_size);
+    }
+
+    std::uint64_t pruned_chunks() {
+        return metrics::Registry::instance().counter("columnar_pruned_chunks_total", "").value();
+    }
+
+    // Batches with a few languages and labels, bots (few user ids) in the odd ones
+    std::vector<db::Tweet> write(std::size_t batches) {
+        std::mt19937 rng(1);
+        std::vector<db::Tweet> ret;
+        db::ColumnarWriter writer(path);
+        for (std::size_t b = 0; b < batches; ++b) {
+            std::vector<db::Tweet> batch;
+            const std::size_t rows = 1 + rng() % 300;
+            for (std::size_t i = 0; i < rows; ++i) {
+                const time_t timestamp = start + b * 1000 + rng() % 1500;
+                const std::string lang = b % 5 == 0 ? "fr" : (rng() % 2 ? "en" : "es");
+                const std::string user_id = "u" + std::to_string(rng() % (b % 2 ? 5 : 100000));
+                const std::string label = b % 3 ? "pos" : "";
+                batch.emplace_back(timestamp, std::to_string(rng()), lang, user_id, "#a,#b", "text " + std::to_string(rng()), label, float(rng() % 100) / 100);
+            }
+            writer.insert(batch);
+            ret.insert(ret.end(), batch.begin(), batch.end());
+        }
+        return ret;
+    }
+
+    template <class Predicate>
+    std::vector<db::Tweet> expected(const std::vector<db::Tweet>& tweets, Predicate p) {
+        std::vector<db::Tweet> ret;
+        for (auto& tweet: tweets) {
+            if (p(tweet)) ret.push_back(tweet);
+        }
+        return ret;
+    }
+
+    void round_trip() {
+        std::remove(path);
+        const auto tweets = write(50);
+        db::ColumnarReader reader(path);
+        CHECK(reader.all() == tweets);
+        CHECK(reader.chunks().size() == 50);
+
+        std::mt19937 rng(2);
+        for (int i = 0; i < 100; ++i) {
+            const time_t init = start + rng() % 52000, end = init + rng() % 5000;
+            CHECK(reader.filter(init, end) == expected(tweets, [=](const db::Tweet& t) { return std::get<0>(t) >= init && std::get<0>(t) < end; }));
+        }
+    }
+
+    void predicates() {
+        std::remove(path);
+        const auto tweets = write(50);
+        db::ColumnarReader reader(path);
+
+        // only one chunk in five has tweets in french, the others don't have it in their dictionary
+        db::predicate where;
+        where.lang = "fr";
+        auto pruned = pruned_chunks();
+        CHECK(reader.filter(where) == expected(tweets, [](const db::Tweet& t) { return std::get<2>(t) == "fr"; }));
+        CHECK(pruned_chunks() - pruned == 40);
+
+        where = {};
+        where.label = "pos";
+        where.user_id = "u3";
+        where.init = start + 10000;
+        CHECK(reader.filter(where) == expected(tweets, [&](const db::Tweet& t) {
+            return std::get<6>(t) == "pos" && std::get<3>(t) == "u3" && std::get<0>(t) >= where.init;
+        }));
+
+        where = {};
+        where.lang = "de";
+        pruned = pruned_chunks();
+        CHECK(reader.filter(where).empty());
+        CHECK(pruned_chunks() - pruned == 50);
+    }
+
+    void truncated_tail() {
+        std::remove(path);
+        const auto tweets = write(10);
+        db::ColumnarReader reader(path);
+        const auto chunks = reader.chunks();
+
+        // a crash in the middle of the last chunk
+        CHECK(::truncate(path, file_size() - 10) == 0);
+        CHECK(reader.chunks().size() == 9);
+        const auto kept = reader.all();
+        CHECK(kept == std::vector<db::Tweet>(tweets.begin(), tweets.begin() + kept.size()));
+        CHECK(kept.size() == tweets.size() - chunks.back().rows);
+
+        // the writer removes it before appending
+        {
+            db::ColumnarWriter writer(path);
+            writer.insert({tweets.back()});
+        }
+        auto all = reader.all();
+        CHECK(reader.chunks().size() == 10);
+        CHECK(all.size() == kept.size() + 1);
+        CHECK(all.back() == tweets.back());
+
+        // and a crash while writing the magic of a new file
+        std::remove(path);
+        std::FILE* file = std::fopen(path, "wb");
+        std::fwrite("TWC", 1, 3, file);
+        std::fclose(file);
+        {
+            db::ColumnarWriter writer(path);
+            writer.insert({tweets.front()});
+        }
+        CHECK(reader.all() == std::vector<db::Tweet>{tweets.front()});
+    }
+
+    void not_columnar() {
+        for (const std::string content: {"hello", "not a columnar file"}) {
+            std::remove(path);
+            std::FILE* file = std::fopen(path, "wb");
+            std::fwrite(content.data(), 1, content.size(), file);
+            std::fclose(file);
+            bool thrown = false;
+            try {
+                db::ColumnarWriter writer(path);
+            } catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            CHECK(thrown);
+            CHECK(file_size() == content.size());  // untouched
+        }
+    }
+}
+
+int main() {
+    round_trip();
+    predicates();
+    truncated_tail();
+    not_columnar();
+    std::remove(path);
+    std::cout << "columnar: ok" << std::endl;
+    return 0;
+}
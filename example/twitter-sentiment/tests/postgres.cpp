@@ -0,0 +1,102 @@
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include <pqxx/pqxx>
+
+#include "check.h"
+#include "db/tweet.h"
+
+// Round trip through PostgreSQL: a table created by an older version (without label nor score) is
+//  migrated by 'create', tweets are inserted, read back with a cursor and labelled with a single update.
+//  It needs a database (the usual PG* variables), without PGHOST nor PGDATABASE it is skipped.
+
+namespace {
+
+    const int skipped = 77;  // SKIP_RETURN_CODE of the test
+    // everything happens in a schema of its own, the tables of the application are never touched
+    const std::string schema = "test_sentiment";
+    const std::string table = "tweets_eurovision";
+
+    pqxx::result exec(pqxx::connection& connection, const std::string& query) {
+        pqxx::nontransaction work(connection);
+        return work.exec(query);
+    }
+
+    // Reads every row of the cursor, by id
+    std::map<std::string, db::Tweet> read(db::TweetCursor& cursor) {
+        std::map<std::string, db::Tweet> ret;
+        std::vector<db::Tweet> rows;
+        while (cursor.next(rows)) {
+            CHECK(rows.size() <= 2);
+            for (auto& row: rows) {
+                ret[std::get<1>(row)] = row;
+            }
+        }
+        return ret;
+    }
+}
+
+int main() {
+    if (!std::getenv("PGHOST") && !std::getenv("PGDATABASE")) {
+        std::cout << "postgres: skipped, PGHOST and PGDATABASE are not set" << std::endl;
+        return skipped;
+    }
+
+    pqxx::connection connection;
+    exec(connection, "DROP SCHEMA IF EXISTS " + schema + " CASCADE");
+    exec(connection, "CREATE SCHEMA " + schema);
+    exec(connection, "SET search_path TO " + schema);
+    exec(connection, "CREATE TABLE " + table + " (timestamp_ms bigint, id_str varchar, lang varchar(10), user_id varchar, hashtags varchar, text varchar)");
+
+    db::TweetManager tweets(connection);
+    tweets.insert(1526140800000, "1", "en", "10", "", "before the migration");
+    tweets.create();
+    CHECK(exec(connection, "SELECT count(*) FROM pg_indexes WHERE schemaname = '" + schema + "' AND indexname = '" + table + "_id_str_idx'")[0][0].as<int>() == 1);
+    tweets.create();  // nothing left to migrate
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    tweets.insert({
+            db::Tweet{1526140800001, "2", "en", "11", "#eurovision", "it's a 'quoted' text", "", 0.f},
+            db::Tweet{1526140800002, "3", "es", "12", "", "sin etiqueta", "", nan},
+            db::Tweet{1526140800003, "4", "en", "13", "", "already labelled", "positive", 0.75f}});
+
+    {
+        // the cursor keeps a transaction open on the connection until it is destroyed
+        auto cursor = tweets.cursor("en", false, 2);
+        auto rows = read(*cursor);
+        CHECK(rows.size() == 3);
+        CHECK(std::get<5>(rows["1"]) == "before the migration");
+        CHECK(std::get<6>(rows["1"]).empty());
+        CHECK(std::get<5>(rows["2"]) == "it's a 'quoted' text");
+        CHECK(std::get<4>(rows["2"]) == "#eurovision");
+        CHECK(std::get<6>(rows["4"]) == "positive");
+        CHECK(std::abs(std::get<7>(rows["4"]) - 0.75f) < 1e-6f);
+    }
+
+    tweets.update({
+            db::Label{"1", "negative", 0.5f},
+            db::Label{"3", "neutral", std::numeric_limits<float>::infinity()},
+            db::Label{"4", "negative", 0.25f}});
+
+    {
+        auto cursor = tweets.cursor("", true, 2);
+        auto rows = read(*cursor);
+        CHECK(rows.size() == 3);
+        CHECK(rows.count("2") == 0);
+        CHECK(std::get<6>(rows["1"]) == "negative");
+        CHECK(std::abs(std::get<7>(rows["1"]) - 0.5f) < 1e-6f);
+        CHECK(std::get<6>(rows["3"]) == "neutral");
+        CHECK(std::get<7>(rows["3"]) == 0.f);  // stored as NULL
+        CHECK(std::get<6>(rows["4"]) == "negative");
+        CHECK(std::abs(std::get<7>(rows["4"]) - 0.25f) < 1e-6f);
+    }
+
+    exec(connection, "DROP SCHEMA " + schema + " CASCADE");
+    std::cout << "postgres: ok" << std::endl;
+    return 0;
+}
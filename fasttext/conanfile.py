@@ -14,7 +14,7 @@ class FastText(ConanFile):
     default_options = {"shared": False, "fPIC": True}
     generators = "cmake"
 
-    exports_sources = "CMakeLists.txt"
+    exports_sources = "CMakeLists.txt", "ext/*"
 
     def configure(self):
         if self.settings.compiler == 'Visual Studio':
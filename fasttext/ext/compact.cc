@@ -0,0 +1,297 @@
+#include "compact.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FASTTEXT_F16C 1
+#include <immintrin.h>
+#else
+#define FASTTEXT_F16C 0
+#endif
+
+namespace fasttext {
+
+namespace {
+
+uint32_t bitsOf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+float fromBits(uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Rows are processed in 'Lanes' independent partial sums so the compiler can
+// vectorize them (see kernels.h)
+const int64_t Lanes = 8;
+
+real dotHalf(const uint16_t* row, const real* vec, int64_t n) {
+  real acc[Lanes] = {};
+  int64_t j = 0;
+  for (; j + Lanes <= n; j += Lanes) {
+    for (int64_t l = 0; l < Lanes; l++) {
+      acc[l] += fromHalf(row[j + l]) * vec[j + l];
+    }
+  }
+  real sum = 0.0;
+  for (; j < n; j++) {
+    sum += fromHalf(row[j]) * vec[j];
+  }
+  for (int64_t l = 0; l < Lanes; l++) {
+    sum += acc[l];
+  }
+  return sum;
+}
+
+void addHalf(const uint16_t* row, real* out, int64_t n, real a) {
+  for (int64_t j = 0; j < n; j++) {
+    out[j] += a * fromHalf(row[j]);
+  }
+}
+
+#if FASTTEXT_F16C
+
+// Hardware conversion, the library is not built with -mf16c so these are
+// compiled for the instruction set and only used if the CPU supports it
+__attribute__((target("avx,f16c"))) real dotHalfF16C(
+    const uint16_t* row,
+    const real* vec,
+    int64_t n) {
+  __m256 acc = _mm256_setzero_ps();
+  int64_t j = 0;
+  for (; j + Lanes <= n; j += Lanes) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j));
+    acc = _mm256_add_ps(
+        acc, _mm256_mul_ps(_mm256_cvtph_ps(h), _mm256_loadu_ps(vec + j)));
+  }
+  float lanes[Lanes];
+  _mm256_storeu_ps(lanes, acc);
+  real sum = 0.0;
+  for (; j < n; j++) {
+    sum += fromHalf(row[j]) * vec[j];
+  }
+  for (int64_t l = 0; l < Lanes; l++) {
+    sum += lanes[l];
+  }
+  return sum;
+}
+
+__attribute__((target("avx,f16c"))) void addHalfF16C(
+    const uint16_t* row,
+    real* out,
+    int64_t n,
+    real a) {
+  const __m256 scale = _mm256_set1_ps(a);
+  int64_t j = 0;
+  for (; j + Lanes <= n; j += Lanes) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + j));
+    __m256 v = _mm256_mul_ps(_mm256_cvtph_ps(h), scale);
+    _mm256_storeu_ps(out + j, _mm256_add_ps(_mm256_loadu_ps(out + j), v));
+  }
+  for (; j < n; j++) {
+    out[j] += a * fromHalf(row[j]);
+  }
+}
+
+bool hasF16C() {
+  static const bool supported =
+      __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+  return supported;
+}
+
+#endif
+
+real dotBytes(const int8_t* row, const real* vec, int64_t n) {
+  real acc[Lanes] = {};
+  int64_t j = 0;
+  for (; j + Lanes <= n; j += Lanes) {
+    for (int64_t l = 0; l < Lanes; l++) {
+      acc[l] += real(row[j + l]) * vec[j + l];
+    }
+  }
+  real sum = 0.0;
+  for (; j < n; j++) {
+    sum += real(row[j]) * vec[j];
+  }
+  for (int64_t l = 0; l < Lanes; l++) {
+    sum += acc[l];
+  }
+  return sum;
+}
+
+void addBytes(const int8_t* row, real* out, int64_t n, real a) {
+  for (int64_t j = 0; j < n; j++) {
+    out[j] += a * real(row[j]);
+  }
+}
+
+} // namespace
+
+storage parseStorage(const std::string& name) {
+  if (name == "f32") {
+    return storage::f32;
+  } else if (name == "f16") {
+    return storage::f16;
+  } else if (name == "i8") {
+    return storage::i8;
+  }
+  throw std::invalid_argument("Unknown storage: " + name);
+}
+
+std::string storageName(storage mode) {
+  switch (mode) {
+    case storage::f16:
+      return "f16";
+    case storage::i8:
+      return "i8";
+    default:
+      return "f32";
+  }
+}
+
+uint16_t toHalf(real value) {
+  const uint32_t bits = bitsOf(value);
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const int32_t exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (exponent == 0xff) {
+    // inf or nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  const int32_t e = exponent - 127 + 15;
+  if (e >= 0x1f) {
+    return sign | 0x7c00;
+  }
+  if (e <= 0) {
+    // subnormal (or zero) in half precision
+    if (e < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    const int32_t shift = 14 - e;
+    uint32_t half = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t middle = 1u << (shift - 1);
+    if (rest > middle || (rest == middle && (half & 1))) {
+      half++;
+    }
+    return sign | half;
+  }
+  // round to nearest even, a carry into the exponent is still correct
+  uint32_t half = (uint32_t(e) << 10) | (mantissa >> 13);
+  const uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    half++;
+  }
+  return sign | half;
+}
+
+real fromHalf(uint16_t value) {
+  const uint32_t sign = uint32_t(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1f;
+  const uint32_t mantissa = value & 0x3ff;
+  if (exponent == 0) {
+    const real magnitude = std::ldexp(real(mantissa), -24);
+    return sign ? -magnitude : magnitude;
+  }
+  if (exponent == 0x1f) {
+    return fromBits(sign | 0x7f800000 | (mantissa << 13));
+  }
+  return fromBits(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+CompactMatrix::CompactMatrix(const Matrix& matrix, storage mode)
+    : storage_(mode), m_(matrix.size(0)), n_(matrix.size(1)) {
+  if (mode == storage::f16) {
+    half_.resize(m_ * n_);
+    for (int64_t i = 0; i < m_; i++) {
+      for (int64_t j = 0; j < n_; j++) {
+        half_[i * n_ + j] = toHalf(matrix.at(i, j));
+      }
+    }
+  } else if (mode == storage::i8) {
+    bytes_.resize(m_ * n_);
+    scale_.resize(m_);
+    for (int64_t i = 0; i < m_; i++) {
+      real max = 0.0;
+      for (int64_t j = 0; j < n_; j++) {
+        max = std::max(max, std::abs(matrix.at(i, j)));
+      }
+      scale_[i] = max / 127;
+      const real inverse = max > 0 ? 127 / max : 0.0;
+      for (int64_t j = 0; j < n_; j++) {
+        bytes_[i * n_ + j] = int8_t(std::round(matrix.at(i, j) * inverse));
+      }
+    }
+  } else {
+    throw std::invalid_argument("CompactMatrix needs f16 or i8 storage");
+  }
+}
+
+int64_t CompactMatrix::size(int64_t dim) const {
+  return dim == 0 ? m_ : n_;
+}
+
+storage CompactMatrix::getStorage() const {
+  return storage_;
+}
+
+size_t CompactMatrix::memory() const {
+  return half_.size() * sizeof(uint16_t) + bytes_.size() * sizeof(int8_t) +
+      scale_.size() * sizeof(real);
+}
+
+real CompactMatrix::dotRow(const real* vec, int64_t i) const {
+  if (storage_ == storage::f16) {
+#if FASTTEXT_F16C
+    if (hasF16C()) {
+      return dotHalfF16C(half_.data() + i * n_, vec, n_);
+    }
+#endif
+    return dotHalf(half_.data() + i * n_, vec, n_);
+  }
+  return scale_[i] * dotBytes(bytes_.data() + i * n_, vec, n_);
+}
+
+void CompactMatrix::addRow(real* out, int64_t i, real a) const {
+  if (storage_ == storage::f16) {
+#if FASTTEXT_F16C
+    if (hasF16C()) {
+      addHalfF16C(half_.data() + i * n_, out, n_, a);
+      return;
+    }
+#endif
+    addHalf(half_.data() + i * n_, out, n_, a);
+  } else {
+    addBytes(bytes_.data() + i * n_, out, n_, a * scale_[i]);
+  }
+}
+
+void CompactMatrix::average(const int32_t* ids, size_t n, real* out) const {
+  std::fill(out, out + n_, real(0.0));
+  for (size_t i = 0; i < n; i++) {
+    addRow(out, ids[i], 1.0);
+  }
+  if (n > 0) {
+    const real scale = real(1.0) / n;
+    for (int64_t j = 0; j < n_; j++) {
+      out[j] *= scale;
+    }
+  }
+}
+
+void CompactMatrix::scores(const real* hidden, real* out) const {
+  for (int64_t i = 0; i < m_; i++) {
+    out[i] = dotRow(hidden, i);
+  }
+}
+
+} // namespace fasttext
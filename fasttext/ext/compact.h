@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "matrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+// How the rows of the input and output matrices are kept in memory
+enum class storage : int { f32 = 0, f16, i8 };
+
+storage parseStorage(const std::string& name);
+std::string storageName(storage mode);
+
+uint16_t toHalf(real value);
+real fromHalf(uint16_t value);
+
+// Read-only copy of a Matrix with its rows stored as float16 (half the memory)
+// or as int8 with one scale per row (a quarter of the memory). Rows are
+// dequantized on the fly, so the only extra memory used to compute with them
+// is the output.
+class CompactMatrix {
+ protected:
+  storage storage_;
+  int64_t m_;
+  int64_t n_;
+  std::vector<uint16_t> half_;
+  std::vector<int8_t> bytes_;
+  std::vector<real> scale_;
+
+ public:
+  CompactMatrix(const Matrix& matrix, storage mode);
+
+  int64_t size(int64_t dim) const;
+  storage getStorage() const;
+  // Bytes used by the rows (and scales)
+  size_t memory() const;
+
+  real dotRow(const real* vec, int64_t i) const;
+  void addRow(real* out, int64_t i, real a) const;
+
+  // out = mean of the rows 'ids'
+  void average(const int32_t* ids, size_t n, real* out) const;
+  // out[i] = dot(row i, hidden)
+  void scores(const real* hidden, real* out) const;
+};
+
+} // namespace fasttext
@@ -0,0 +1,80 @@
+#include "corpus.h"
+
+namespace fasttext {
+
+Corpus::Corpus()
+    : wordOffsets_(1, 0), labelOffsets_(1, 0), hashOffsets_(1, 0), ntokens_(0) {}
+
+void Corpus::add(
+    const std::vector<int32_t>& words,
+    const std::vector<int32_t>& labels,
+    int32_t ntokens) {
+  add(words, labels, std::vector<int32_t>(), ntokens);
+}
+
+void Corpus::add(
+    const std::vector<int32_t>& words,
+    const std::vector<int32_t>& labels,
+    const std::vector<int32_t>& hashes,
+    int32_t ntokens) {
+  words_.insert(words_.end(), words.begin(), words.end());
+  labels_.insert(labels_.end(), labels.begin(), labels.end());
+  hashes_.insert(hashes_.end(), hashes.begin(), hashes.end());
+  wordOffsets_.push_back(words_.size());
+  labelOffsets_.push_back(labels_.size());
+  hashOffsets_.push_back(hashes_.size());
+  tokens_.push_back(ntokens);
+  ntokens_ += ntokens;
+}
+
+void Corpus::append(const Corpus& other) {
+  const size_t words = words_.size(), labels = labels_.size(),
+               hashes = hashes_.size();
+  words_.insert(words_.end(), other.words_.begin(), other.words_.end());
+  labels_.insert(labels_.end(), other.labels_.begin(), other.labels_.end());
+  hashes_.insert(hashes_.end(), other.hashes_.begin(), other.hashes_.end());
+  for (size_t i = 1; i < other.wordOffsets_.size(); i++) {
+    wordOffsets_.push_back(words + other.wordOffsets_[i]);
+    labelOffsets_.push_back(labels + other.labelOffsets_[i]);
+    hashOffsets_.push_back(hashes + other.hashOffsets_[i]);
+  }
+  tokens_.insert(tokens_.end(), other.tokens_.begin(), other.tokens_.end());
+  ntokens_ += other.ntokens_;
+}
+
+void Corpus::clear() {
+  words_.clear();
+  labels_.clear();
+  hashes_.clear();
+  wordOffsets_.assign(1, 0);
+  labelOffsets_.assign(1, 0);
+  hashOffsets_.assign(1, 0);
+  tokens_.clear();
+  ntokens_ = 0;
+}
+
+size_t Corpus::size() const {
+  return wordOffsets_.size() - 1;
+}
+
+int64_t Corpus::ntokens() const {
+  return ntokens_;
+}
+
+int32_t Corpus::get(
+    size_t i,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels,
+    std::vector<int32_t>& hashes) const {
+  words.assign(
+      words_.begin() + wordOffsets_[i], words_.begin() + wordOffsets_[i + 1]);
+  labels.assign(
+      labels_.begin() + labelOffsets_[i],
+      labels_.begin() + labelOffsets_[i + 1]);
+  hashes.assign(
+      hashes_.begin() + hashOffsets_[i],
+      hashes_.begin() + hashOffsets_[i + 1]);
+  return tokens_[i];
+}
+
+} // namespace fasttext
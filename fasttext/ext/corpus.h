@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fasttext {
+
+// Tokenized examples (input ids and labels of each line, as returned by
+// Dictionary::getLine) kept in a few flat arrays, so the data is tokenized
+// once and can be read by any number of threads while training. The examples
+// can also keep the hashes of the words (Predictor::getWords) so the word
+// n-grams are added when they are read, for any 'wordNgrams' and 'bucket'.
+class Corpus {
+ protected:
+  std::vector<int32_t> words_;
+  std::vector<int32_t> labels_;
+  std::vector<int32_t> hashes_;
+  // where each example starts in 'words_', 'labels_' and 'hashes_', plus the
+  // end
+  std::vector<size_t> wordOffsets_;
+  std::vector<size_t> labelOffsets_;
+  std::vector<size_t> hashOffsets_;
+  std::vector<int32_t> tokens_;
+  int64_t ntokens_;
+
+ public:
+  Corpus();
+
+  void add(
+      const std::vector<int32_t>& words,
+      const std::vector<int32_t>& labels,
+      int32_t ntokens);
+  void add(
+      const std::vector<int32_t>& words,
+      const std::vector<int32_t>& labels,
+      const std::vector<int32_t>& hashes,
+      int32_t ntokens);
+  // Adds all the examples of 'other' at the end
+  void append(const Corpus& other);
+  void clear();
+
+  size_t size() const;
+  // Tokens read to build the examples (the count used for the learning rate)
+  int64_t ntokens() const;
+  // Returns the tokens read to build the example, 'hashes' is empty unless
+  // they were added
+  int32_t get(
+      size_t i,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels,
+      std::vector<int32_t>& hashes) const;
+};
+
+} // namespace fasttext
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "real.h"
+
+namespace fasttext {
+namespace kernels {
+
+// Inference loops over rows of 'Dim' reals. When 'Dim' is known at compile
+// time the compiler unrolls and vectorizes them and keeps the accumulators in
+// registers; 'Kernel<0>' is the generic version that reads the dimension at
+// runtime.
+template <int Dim>
+struct Kernel {
+  // out = mean of the rows 'ids' of 'data'
+  static void average(
+      const real* data,
+      int64_t /*dim*/,
+      const int32_t* ids,
+      size_t n,
+      real* out) {
+    real acc[Dim] = {};
+    for (size_t i = 0; i < n; i++) {
+      const real* row = data + int64_t(ids[i]) * Dim;
+      for (int j = 0; j < Dim; j++) {
+        acc[j] += row[j];
+      }
+    }
+    const real scale = n > 0 ? real(1.0) / n : real(0.0);
+    for (int j = 0; j < Dim; j++) {
+      out[j] = acc[j] * scale;
+    }
+  }
+
+  // out[i] = dot(row i of 'data', hidden)
+  static void scores(
+      const real* data,
+      int64_t /*dim*/,
+      int64_t rows,
+      const real* hidden,
+      real* out) {
+    // 'Lanes' independent partial sums: without -ffast-math the compiler
+    // cannot reorder a single running sum, but it vectorizes these
+    const int Lanes = 8;
+    const int Tail = Dim - Dim % Lanes;
+    for (int64_t i = 0; i < rows; i++) {
+      const real* row = data + i * Dim;
+      real acc[Lanes] = {};
+      for (int j = 0; j < Tail; j += Lanes) {
+        for (int l = 0; l < Lanes; l++) {
+          acc[l] += row[j + l] * hidden[j + l];
+        }
+      }
+      real sum = 0.0;
+      for (int j = Tail; j < Dim; j++) {
+        sum += row[j] * hidden[j];
+      }
+      for (int l = 0; l < Lanes; l++) {
+        sum += acc[l];
+      }
+      out[i] = sum;
+    }
+  }
+};
+
+template <>
+struct Kernel<0> {
+  static void average(
+      const real* data,
+      int64_t dim,
+      const int32_t* ids,
+      size_t n,
+      real* out) {
+    std::fill(out, out + dim, real(0.0));
+    for (size_t i = 0; i < n; i++) {
+      const real* row = data + int64_t(ids[i]) * dim;
+      for (int64_t j = 0; j < dim; j++) {
+        out[j] += row[j];
+      }
+    }
+    if (n > 0) {
+      const real scale = real(1.0) / n;
+      for (int64_t j = 0; j < dim; j++) {
+        out[j] *= scale;
+      }
+    }
+  }
+
+  static void scores(
+      const real* data,
+      int64_t dim,
+      int64_t rows,
+      const real* hidden,
+      real* out) {
+    for (int64_t i = 0; i < rows; i++) {
+      const real* row = data + i * dim;
+      real sum = 0.0;
+      for (int64_t j = 0; j < dim; j++) {
+        sum += row[j] * hidden[j];
+      }
+      out[i] = sum;
+    }
+  }
+};
+
+// Same computation as Model::computeOutputSoftmax
+inline void softmax(real* output, int64_t n) {
+  if (n == 0) {
+    return;
+  }
+  real max = *std::max_element(output, output + n);
+  real z = 0.0;
+  for (int64_t i = 0; i < n; i++) {
+    output[i] = std::exp(output[i] - max);
+    z += output[i];
+  }
+  for (int64_t i = 0; i < n; i++) {
+    output[i] /= z;
+  }
+}
+
+struct KernelSet {
+  int dim; // 0 if not specialized
+  void (*average)(const real*, int64_t, const int32_t*, size_t, real*);
+  void (*scores)(const real*, int64_t, int64_t, const real*, real*);
+};
+
+template <int Dim>
+KernelSet make() {
+  return KernelSet{Dim, &Kernel<Dim>::average, &Kernel<Dim>::scores};
+}
+
+// Dimensions of the models we use in production, anything else is generic
+inline KernelSet select(int dim) {
+  switch (dim) {
+    case 10:
+      return make<10>();
+    case 100:
+      return make<100>();
+    case 300:
+      return make<300>();
+    default:
+      return make<0>();
+  }
+}
+
+} // namespace kernels
+} // namespace fasttext
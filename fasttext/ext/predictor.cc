@@ -0,0 +1,425 @@
+#include "predictor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+namespace fasttext {
+
+namespace {
+
+// Per-thread scratch space, so predicting doesn't allocate
+std::vector<real>& buffer(int slot, size_t size) {
+  thread_local std::vector<real> buffers[2];
+  if (buffers[slot].size() < size) {
+    buffers[slot].resize(size);
+  }
+  return buffers[slot];
+}
+
+std::string& scratch() {
+  thread_local std::string token;
+  return token;
+}
+
+// Characters that end a token in Dictionary::readWord
+bool isSeparator(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+      c == '\f' || c == '\0';
+}
+
+// Reads from memory without copying it
+class MemoryBuffer : public std::streambuf {
+ public:
+  MemoryBuffer(const char* begin, const char* end) {
+    char* data = const_cast<char*>(begin);
+    setg(data, data, const_cast<char*>(end));
+  }
+
+  const char* position() const {
+    return gptr();
+  }
+};
+
+} // namespace
+
+Predictor::Predictor()
+    : kernels_(kernels::make<0>()), fast_(false), pruned_(false) {}
+
+void Predictor::loadModel(const std::string& filename, storage mode) {
+  cinput_.reset();
+  coutput_.reset();
+  FastText::loadModel(filename);
+  prepare();
+  if (mode != storage::f32) {
+    compact(mode);
+  }
+}
+
+void Predictor::prepare() {
+  kernels_ = kernels::select(args_->dim);
+  fast_ = !quant_ && args_->model == model_name::sup &&
+      args_->loss != loss_name::hs;
+  pruned_ = dict_->isPruned();
+  if (subwords_) {
+    subwords_->clear();
+  }
+}
+
+void Predictor::compact(storage mode) {
+  if (cinput_) {
+    throw std::logic_error("Model is already compacted");
+  }
+  if (quant_) {
+    throw std::invalid_argument("Quantized models cannot be compacted");
+  }
+  if (args_->model == model_name::sup && !fast_) {
+    throw std::invalid_argument(
+        "Models trained with hierarchical softmax cannot be compacted");
+  }
+  cinput_ = std::make_shared<CompactMatrix>(*input_, mode);
+  coutput_ = std::make_shared<CompactMatrix>(*output_, mode);
+  // the model holds the matrices too
+  model_.reset();
+  input_ = std::make_shared<Matrix>();
+  output_ = std::make_shared<Matrix>();
+  if (subwords_) {
+    subwords_->clear();
+  }
+}
+
+void Predictor::setSubwordCache(size_t capacity, bool vectors) {
+  if (capacity == 0) {
+    subwords_.reset();
+  } else {
+    subwords_ = std::make_shared<SubwordCache>(capacity, vectors);
+  }
+}
+
+std::shared_ptr<const SubwordCache> Predictor::getSubwordCache() const {
+  return subwords_;
+}
+
+std::shared_ptr<const Subwords> Predictor::subwords(
+    const std::string& token) const {
+  std::shared_ptr<const Subwords> cached;
+  if (subwords_ && (cached = subwords_->get(token))) {
+    return cached;
+  }
+
+  auto ret = std::make_shared<Subwords>();
+  ret->hash = dict_->hash(token);
+  ret->id = dict_->getId(token, ret->hash);
+  ret->type = ret->id < 0 ? dict_->getType(token) : dict_->getType(ret->id);
+  if (ret->id >= 0) {
+    ret->ids = dict_->getSubwords(ret->id);
+  } else {
+    ret->ids = dict_->getSubwords(token);
+  }
+  if (subwords_ && subwords_->vectors() && !quant_ && !ret->ids.empty()) {
+    ret->sum.resize(args_->dim);
+    average(ret->ids.data(), ret->ids.size(), ret->sum.data());
+    for (auto& value : ret->sum) {
+      value *= ret->ids.size();
+    }
+  }
+  if (subwords_) {
+    subwords_->put(token, ret);
+  }
+  return ret;
+}
+
+// Same as Dictionary::addWordNgrams, hashes are int32_t there too and the
+// sign extension when they are widened is part of the model
+void Predictor::addWordNgrams(
+    std::vector<int32_t>& line,
+    const std::vector<int32_t>& hashes) const {
+  const int32_t nwords = dict_->nwords();
+  for (int32_t i = 0; i < int32_t(hashes.size()); i++) {
+    uint64_t h = hashes[i];
+    for (int32_t j = i + 1; j < int32_t(hashes.size()) && j < i + args_->wordNgrams;
+         j++) {
+      h = h * 116049371 + hashes[j];
+      line.push_back(nwords + int32_t(h % args_->bucket));
+    }
+  }
+}
+
+bool Predictor::addToken(
+    const std::string& token,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels,
+    std::vector<int32_t>& hashes) const {
+  addSubwords(*subwords(token), words, labels, hashes);
+  return token == Dictionary::EOS;
+}
+
+std::shared_ptr<const Subwords> Predictor::getSubwords(
+    const std::string& token) const {
+  return subwords(token);
+}
+
+void Predictor::addSubwords(
+    const Subwords& entry,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels,
+    std::vector<int32_t>& hashes) const {
+  if (pruned_) {
+    throw std::logic_error("The words of pruned models are not kept apart");
+  }
+  if (entry.type == entry_type::word) {
+    // out of vocabulary EOS has no subwords
+    words.insert(words.end(), entry.ids.begin(), entry.ids.end());
+    hashes.push_back(entry.hash);
+  } else if (entry.type == entry_type::label && entry.id >= 0) {
+    labels.push_back(entry.id - dict_->nwords());
+  }
+}
+
+int32_t Predictor::getLine(
+    std::istream& in,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels) const {
+  if (pruned_) {
+    // word n-grams are remapped by the pruning index, which is private
+    return dict_->getLine(in, words, labels);
+  }
+
+  std::vector<int32_t> hashes;
+  std::string token;
+  int32_t ntokens = 0;
+  words.clear();
+  labels.clear();
+  while (dict_->readWord(in, token)) {
+    ntokens++;
+    if (addToken(token, words, labels, hashes)) {
+      break;
+    }
+  }
+  addWordNgrams(words, hashes);
+  return ntokens;
+}
+
+const char* Predictor::getLine(
+    const char* begin,
+    const char* end,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels) const {
+  if (pruned_) {
+    MemoryBuffer buffer(begin, end);
+    std::istream in(&buffer);
+    dict_->getLine(in, words, labels);
+    return buffer.position();
+  }
+  std::vector<int32_t> hashes;
+  const char* next = getWords(begin, end, words, labels, hashes);
+  addWordNgrams(words, hashes);
+  return next;
+}
+
+const char* Predictor::getWords(
+    const char* begin,
+    const char* end,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels,
+    std::vector<int32_t>& hashes,
+    int32_t* ntokens) const {
+  if (pruned_) {
+    throw std::logic_error("The words of pruned models are not kept apart");
+  }
+  std::string& token = scratch();
+  words.clear();
+  labels.clear();
+  hashes.clear();
+  int32_t count = 0;
+  const char* p = begin;
+  while (p != end) {
+    // same as Dictionary::readWord
+    while (p != end && isSeparator(*p) && *p != '\n') {
+      p++;
+    }
+    if (p == end) {
+      break;
+    }
+    if (*p == '\n') {
+      token = Dictionary::EOS;
+      p++;
+    } else {
+      const char* start = p;
+      while (p != end && !isSeparator(*p)) {
+        p++;
+      }
+      token.assign(start, p - start);
+      // the new line is left for the next token
+      if (p != end && *p != '\n') {
+        p++;
+      }
+    }
+    count++;
+    if (addToken(token, words, labels, hashes)) {
+      break;
+    }
+  }
+  if (ntokens) {
+    *ntokens = count;
+  }
+  return p;
+}
+
+const char* Predictor::predictLine(
+    const char* begin,
+    const char* end,
+    int32_t k,
+    std::vector<std::pair<real, int32_t>>& predictions,
+    real threshold) const {
+  thread_local std::vector<int32_t> words, labels;
+  const char* next = getLine(begin, end, words, labels);
+  predict(k, words, predictions, threshold);
+  return next;
+}
+
+void Predictor::average(const int32_t* ids, size_t n, real* out) const {
+  if (cinput_) {
+    cinput_->average(ids, n, out);
+  } else {
+    kernels_.average(&input_->at(0, 0), args_->dim, ids, n, out);
+  }
+}
+
+void Predictor::scores(const real* hidden, real* out) const {
+  if (coutput_) {
+    coutput_->scores(hidden, out);
+  } else {
+    kernels_.scores(
+        &output_->at(0, 0), args_->dim, output_->size(0), hidden, out);
+  }
+}
+
+storage Predictor::getStorage() const {
+  return cinput_ ? cinput_->getStorage() : storage::f32;
+}
+
+size_t Predictor::memory() const {
+  if (cinput_) {
+    return cinput_->memory() + coutput_->memory();
+  }
+  return (input_->size(0) * input_->size(1) +
+          output_->size(0) * output_->size(1)) *
+      sizeof(real);
+}
+
+int Predictor::specializedDim() const {
+  return kernels_.dim;
+}
+
+void Predictor::predict(
+    int32_t k,
+    const std::vector<int32_t>& words,
+    std::vector<std::pair<real, int32_t>>& predictions,
+    real threshold) const {
+  predictions.clear();
+  if (words.empty()) {
+    return;
+  }
+  if (!fast_) {
+    if (args_->model != model_name::sup) {
+      throw std::invalid_argument("Model needs to be supervised for prediction!");
+    }
+    FastText::predict(k, words, predictions, threshold);
+    for (auto& prediction : predictions) {
+      prediction.first = std::exp(prediction.first);
+    }
+    return;
+  }
+
+  const int64_t dim = args_->dim;
+  const int64_t nlabels = dict_->nlabels();
+  std::vector<real>& hidden = buffer(0, dim);
+  std::vector<real>& output = buffer(1, nlabels);
+  average(words.data(), words.size(), hidden.data());
+  scores(hidden.data(), output.data());
+  kernels::softmax(output.data(), nlabels);
+
+  // same as Model::findKBest, keeping a min-heap of the best k
+  auto greater = std::greater<std::pair<real, int32_t>>();
+  for (int32_t i = 0; i < nlabels; i++) {
+    if (output[i] < threshold) {
+      continue;
+    }
+    if (predictions.size() == size_t(k) && output[i] < predictions.front().first) {
+      continue;
+    }
+    predictions.push_back(std::make_pair(output[i], i));
+    std::push_heap(predictions.begin(), predictions.end(), greater);
+    if (predictions.size() > size_t(k)) {
+      std::pop_heap(predictions.begin(), predictions.end(), greater);
+      predictions.pop_back();
+    }
+  }
+  std::sort_heap(predictions.begin(), predictions.end(), greater);
+}
+
+void Predictor::wordVector(const std::string& word, real* out) const {
+  std::shared_ptr<const Subwords> entry = subwords(word);
+  if (!entry->sum.empty()) {
+    const real scale = real(1.0) / entry->ids.size();
+    for (int64_t j = 0; j < args_->dim; j++) {
+      out[j] = entry->sum[j] * scale;
+    }
+  } else {
+    average(entry->ids.data(), entry->ids.size(), out);
+  }
+}
+
+void Predictor::getWordVector(Vector& vec, const std::string& word) const {
+  if (quant_) {
+    FastText::getWordVector(vec, word);
+    return;
+  }
+  wordVector(word, &vec[0]);
+}
+
+void Predictor::getSentenceVector(std::istream& in, Vector& svec) const {
+  const int64_t dim = args_->dim;
+  svec.zero();
+  if (quant_) {
+    const_cast<Predictor*>(this)->FastText::getSentenceVector(in, svec);
+    return;
+  }
+
+  if (args_->model == model_name::sup) {
+    std::vector<int32_t> line, labels;
+    getLine(in, line, labels);
+    average(line.data(), line.size(), &svec[0]);
+    return;
+  }
+
+  // average of the normalized word vectors (as FastText::getSentenceVector)
+  std::vector<real>& vec = buffer(0, dim);
+  std::string sentence;
+  std::getline(in, sentence);
+  std::istringstream iss(sentence);
+  std::string word;
+  int32_t count = 0;
+  while (iss >> word) {
+    wordVector(word, vec.data());
+    real norm = 0.0;
+    for (int64_t j = 0; j < dim; j++) {
+      norm += vec[j] * vec[j];
+    }
+    norm = std::sqrt(norm);
+    if (norm > 0) {
+      for (int64_t j = 0; j < dim; j++) {
+        svec[j] += vec[j] / norm;
+      }
+      count++;
+    }
+  }
+  if (count > 0) {
+    svec.mul(1.0 / count);
+  }
+}
+
+} // namespace fasttext
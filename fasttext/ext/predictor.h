@@ -0,0 +1,222 @@
+#pragma once
+
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#include "compact.h"
+#include "fasttext.h"
+#include "kernels.h"
+#include "subwords.h"
+
+namespace fasttext {
+
+// FastText model with a faster inference path for supervised models: the
+// kernels are specialized at compile time for the common dimensions and
+// selected when the model is loaded. Quantized models and models trained with
+// hierarchical softmax fall back to the upstream implementation.
+//
+// The matrices can also be kept as float16 or int8 (see CompactMatrix). Then
+// the float32 ones are released, and only the methods of this class can be
+// used: the ones inherited from FastText need the float32 matrices.
+class Predictor : public FastText {
+ protected:
+  kernels::KernelSet kernels_;
+  bool fast_;
+  std::shared_ptr<CompactMatrix> cinput_;
+  std::shared_ptr<CompactMatrix> coutput_;
+  std::shared_ptr<SubwordCache> subwords_;
+  bool pruned_;
+
+  void prepare();
+
+  std::shared_ptr<const Subwords> subwords(const std::string& token) const;
+  void wordVector(const std::string& word, real* out) const;
+  // Adds the ids of 'token' to 'words' (or 'labels'), returns true if the
+  // line ends here (the token is EOS)
+  bool addToken(
+      const std::string& token,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels,
+      std::vector<int32_t>& hashes) const;
+
+  void average(const int32_t* ids, size_t n, real* out) const;
+  void scores(const real* hidden, real* out) const;
+
+ public:
+  Predictor();
+
+  void loadModel(const std::string& filename, storage mode = storage::f32);
+  // Replaces the float32 matrices of the loaded model
+  void compact(storage mode);
+
+  // Keeps the subwords of the last 'capacity' tokens seen (and the sum of
+  // their rows if 'vectors'), 0 disables the cache
+  void setSubwordCache(size_t capacity, bool vectors = false);
+  std::shared_ptr<const SubwordCache> getSubwordCache() const;
+
+  // Same as Dictionary::getLine, using the subword cache
+  int32_t getLine(
+      std::istream& in,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels) const;
+
+  // Same as Dictionary::getLine reading from memory (no stream, no copy of the
+  // text): tokens are split at the same characters and a new line is EOS.
+  // Returns where the next line starts.
+  const char* getLine(
+      const char* begin,
+      const char* end,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels) const;
+
+  // Same as getLine for text that is already split into tokens (anything with
+  // data() and size(), like std::string or std::string_view), as if they were
+  // read one after the other. There is no new line at the end: add
+  // Dictionary::EOS as the last token to get the ids of a full line.
+  template <class Iterator>
+  int32_t getTokens(
+      Iterator first,
+      Iterator last,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels) const {
+    if (pruned_) {
+      std::string line;
+      for (; first != last; ++first) {
+        line.append(first->data(), first->size()).append(" ");
+      }
+      std::istringstream in(line);
+      return getLine(in, words, labels);
+    }
+    std::vector<int32_t> hashes;
+    const int32_t ntokens = getWords(first, last, words, labels, hashes);
+    addWordNgrams(words, hashes);
+    return ntokens;
+  }
+
+  // Same as getLine and getTokens without the word n-grams, 'hashes' are what
+  // addWordNgrams needs to add them. The words can be kept and completed
+  // later for models with any 'wordNgrams' and 'bucket' (the dictionary
+  // doesn't depend on them unless there are character n-grams). Pruned models
+  // keep only some of the word n-grams, so they throw std::logic_error.
+  const char* getWords(
+      const char* begin,
+      const char* end,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels,
+      std::vector<int32_t>& hashes,
+      int32_t* ntokens = nullptr) const;
+
+  template <class Iterator>
+  int32_t getWords(
+      Iterator first,
+      Iterator last,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels,
+      std::vector<int32_t>& hashes) const {
+    if (pruned_) {
+      throw std::logic_error("The words of pruned models are not kept apart");
+    }
+    std::string token;
+    int32_t ntokens = 0;
+    words.clear();
+    labels.clear();
+    hashes.clear();
+    for (; first != last; ++first) {
+      if (first->size() == 0) {
+        continue;
+      }
+      token.assign(first->data(), first->size());
+      ntokens++;
+      if (addToken(token, words, labels, hashes)) {
+        break;
+      }
+    }
+    return ntokens;
+  }
+
+  // Models quantized with a cutoff keep only some of the word n-grams, the
+  // words can't be kept apart from them (see getWords)
+  bool isPruned() const {
+    return pruned_;
+  }
+
+  // What getWords computes for a token, through the subword cache. Callers
+  // that already have their own ids for the tokens can keep these and use
+  // addSubwords instead of getWords, so tokens are not hashed again.
+  std::shared_ptr<const Subwords> getSubwords(const std::string& token) const;
+  // Adds the ids of the token to 'words' (or 'labels') as getWords does,
+  // throws std::logic_error for pruned models
+  void addSubwords(
+      const Subwords& entry,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels,
+      std::vector<int32_t>& hashes) const;
+
+  // Adds the ids of the word n-grams (as Dictionary::addWordNgrams)
+  void addWordNgrams(
+      std::vector<int32_t>& line,
+      const std::vector<int32_t>& hashes) const;
+
+  // Top 'k' labels for the first line of the text (see getLine), returns
+  // where the next line starts
+  const char* predictLine(
+      const char* begin,
+      const char* end,
+      int32_t k,
+      std::vector<std::pair<real, int32_t>>& predictions,
+      real threshold = 0.0) const;
+
+#if __cplusplus >= 201703L
+  std::string_view::size_type getLine(
+      std::string_view text,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels) const {
+    return getLine(text.data(), text.data() + text.size(), words, labels) -
+        text.data();
+  }
+
+  std::string_view::size_type predictLine(
+      std::string_view text,
+      int32_t k,
+      std::vector<std::pair<real, int32_t>>& predictions,
+      real threshold = 0.0) const {
+    return predictLine(
+               text.data(),
+               text.data() + text.size(),
+               k,
+               predictions,
+               threshold) -
+        text.data();
+  }
+#endif
+
+  using FastText::predict;
+
+  // Top 'k' labels for the input ids (as returned by Dictionary::getLine),
+  // same arguments as FastText::predict but these are probabilities, not
+  // log-probabilities.
+  void predict(
+      int32_t k,
+      const std::vector<int32_t>& words,
+      std::vector<std::pair<real, int32_t>>& predictions,
+      real threshold = 0.0) const;
+
+  void getWordVector(Vector& vec, const std::string& word) const;
+  void getSentenceVector(std::istream& in, Vector& svec) const;
+
+  storage getStorage() const;
+  // Bytes used by the input and output matrices
+  size_t memory() const;
+
+  // Dimension the kernels are specialized for (0 if generic)
+  int specializedDim() const;
+};
+
+} // namespace fasttext
@@ -0,0 +1,91 @@
+#include "subwords.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace fasttext {
+
+SubwordCache::SubwordCache(size_t capacity, bool vectors, size_t shards)
+    : vectors_(vectors),
+      nshards_(std::max<size_t>(1, shards)),
+      shards_(new Shard[nshards_]),
+      hits_(0),
+      misses_(0) {
+  for (size_t i = 0; i < nshards_; i++) {
+    shards_[i].capacity = std::max<size_t>(1, capacity / nshards_);
+  }
+}
+
+SubwordCache::Shard& SubwordCache::shard(const std::string& token) {
+  // use the high bits, the low ones are used by the map inside the shard
+  const size_t h = std::hash<std::string>()(token);
+  return shards_[(h ^ (h >> 16)) % nshards_];
+}
+
+std::shared_ptr<const Subwords> SubwordCache::get(const std::string& token) {
+  Shard& shard = this->shard(token);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(token);
+  if (it == shard.index.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  shard.items.splice(shard.items.begin(), shard.items, it->second);
+  return it->second->second;
+}
+
+void SubwordCache::put(
+    const std::string& token,
+    std::shared_ptr<const Subwords> subwords) {
+  Shard& shard = this->shard(token);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(token);
+  if (it != shard.index.end()) {
+    // another thread computed it meanwhile
+    shard.items.splice(shard.items.begin(), shard.items, it->second);
+    return;
+  }
+  shard.items.emplace_front(token, std::move(subwords));
+  shard.index.emplace(token, shard.items.begin());
+  if (shard.items.size() > shard.capacity) {
+    shard.index.erase(shard.items.back().first);
+    shard.items.pop_back();
+  }
+}
+
+void SubwordCache::clear() {
+  for (size_t i = 0; i < nshards_; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    shards_[i].index.clear();
+    shards_[i].items.clear();
+  }
+}
+
+bool SubwordCache::vectors() const {
+  return vectors_;
+}
+
+size_t SubwordCache::size() const {
+  size_t ret = 0;
+  for (size_t i = 0; i < nshards_; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    ret += shards_[i].items.size();
+  }
+  return ret;
+}
+
+uint64_t SubwordCache::hits() const {
+  return hits_;
+}
+
+uint64_t SubwordCache::misses() const {
+  return misses_;
+}
+
+double SubwordCache::hitRate() const {
+  const uint64_t hits = hits_, total = hits + misses_;
+  return total ? double(hits) / total : 0.0;
+}
+
+} // namespace fasttext
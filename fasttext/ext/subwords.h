@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dictionary.h"
+#include "real.h"
+
+namespace fasttext {
+
+// Everything Dictionary::getLine computes for a token
+struct Subwords {
+  uint32_t hash;
+  int32_t id; // -1 if out of vocabulary
+  entry_type type;
+  // Input rows of the token (the word and its character n-grams)
+  std::vector<int32_t> ids;
+  // Sum of the rows in 'ids', only if the cache keeps vectors
+  std::vector<real> sum;
+};
+
+// Bounded cache from token to its subwords, evicting the least recently used
+// ones. Tweets are full of misspellings, elongations and hashtags that are out
+// of vocabulary, and computing their character n-grams (and hashing them) is
+// most of the time spent tokenizing. It is split into shards, each with its own
+// lock and its share of the capacity, so concurrent users seldom wait.
+class SubwordCache {
+ protected:
+  typedef std::pair<std::string, std::shared_ptr<const Subwords>> Item;
+
+  struct Shard {
+    std::mutex mutex;
+    size_t capacity;
+    std::list<Item> items; // most recently used first
+    std::unordered_map<std::string, std::list<Item>::iterator> index;
+  };
+
+  const bool vectors_;
+  const size_t nshards_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+
+  Shard& shard(const std::string& token);
+
+ public:
+  explicit SubwordCache(size_t capacity, bool vectors = false, size_t shards = 16);
+
+  // Returns nullptr (and counts a miss) if the token is not in the cache
+  std::shared_ptr<const Subwords> get(const std::string& token);
+  void put(const std::string& token, std::shared_ptr<const Subwords> subwords);
+  void clear();
+
+  bool vectors() const;
+  size_t size() const;
+  uint64_t hits() const;
+  uint64_t misses() const;
+  double hitRate() const;
+};
+
+} // namespace fasttext
@@ -0,0 +1,144 @@
+#include "trainer.h"
+
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "model.h"
+
+namespace fasttext {
+
+namespace {
+
+void checkArgs(const Args& args) {
+  if (args.model != model_name::sup) {
+    throw std::invalid_argument("Only supervised models can be trained");
+  }
+  if (args.bucket == 0 && args.wordNgrams > 1) {
+    throw std::invalid_argument("Word n-grams need buckets");
+  }
+}
+
+void checkDictionary(const std::shared_ptr<Dictionary>& dict) {
+  if (!dict) {
+    throw std::logic_error("The dictionary has not been read yet");
+  }
+}
+
+} // namespace
+
+// The dictionary is created by readDictionary (or shared), an empty one would
+// allocate its whole hash table for nothing
+Trainer::Trainer(const Args& args) : trainLoss_(0.0) {
+  checkArgs(args);
+  args_ = std::make_shared<Args>(args);
+  quant_ = false;
+}
+
+Trainer::Trainer(const Args& args, const Trainer& other) : trainLoss_(0.0) {
+  checkArgs(args);
+  checkDictionary(other.dict_);
+  args_ = std::make_shared<Args>(args);
+  dict_ = other.dict_;
+  quant_ = false;
+  prepare();
+}
+
+void Trainer::readDictionary(std::istream& in) {
+  dict_ = std::make_shared<Dictionary>(args_);
+  dict_->readFromFile(in);
+  if (dict_->nlabels() == 0) {
+    throw std::invalid_argument("No labels in the training data");
+  }
+  prepare();
+}
+
+// Same as FastText::trainThread, the examples come from the corpus: each
+// thread starts at a different place and goes round it until all the threads
+// together have seen 'epoch' times the tokens
+real Trainer::trainThread(
+    const Corpus& corpus,
+    int32_t threadId,
+    std::atomic<int64_t>& tokenCount) {
+  Model model(input_, output_, args_, threadId);
+  model.setTargetCounts(dict_->getCounts(entry_type::label));
+
+  const int64_t ntokens = corpus.ntokens();
+  size_t i = corpus.size() * threadId / args_->thread;
+  int64_t localTokenCount = 0;
+  std::vector<int32_t> line, labels, hashes;
+  while (tokenCount < args_->epoch * ntokens) {
+    const real progress = real(tokenCount) / (args_->epoch * ntokens);
+    const real lr = args_->lr * (1.0 - progress);
+    localTokenCount += corpus.get(i, line, labels, hashes);
+    addWordNgrams(line, hashes);
+    if (!labels.empty() && !line.empty()) {
+      std::uniform_int_distribution<> uniform(0, labels.size() - 1);
+      model.update(line, labels[uniform(model.rng)], lr);
+    }
+    if (localTokenCount > args_->lrUpdateRate) {
+      tokenCount += localTokenCount;
+      localTokenCount = 0;
+    }
+    if (++i == corpus.size()) {
+      i = 0;
+    }
+  }
+  return model.getLoss();
+}
+
+void Trainer::train(const Corpus& corpus) {
+  if (corpus.size() == 0 || corpus.ntokens() == 0) {
+    throw std::invalid_argument("Nothing to train with");
+  }
+  checkDictionary(dict_);
+  cinput_.reset();
+  coutput_.reset();
+  input_ = std::make_shared<Matrix>(
+      dict_->nwords() + args_->bucket, args_->dim);
+  input_->uniform(1.0 / args_->dim);
+  output_ = std::make_shared<Matrix>(dict_->nlabels(), args_->dim);
+  output_->zero();
+
+  std::atomic<int64_t> tokenCount(0);
+  std::vector<real> losses(args_->thread);
+  std::vector<std::thread> threads;
+  for (int32_t i = 0; i < args_->thread; i++) {
+    threads.push_back(std::thread([&, i]() {
+      losses[i] = trainThread(corpus, i, tokenCount);
+    }));
+  }
+  trainLoss_ = 0.0;
+  for (int32_t i = 0; i < args_->thread; i++) {
+    threads[i].join();
+    trainLoss_ += losses[i] / args_->thread;
+  }
+
+  model_ = std::make_shared<Model>(input_, output_, args_, 0);
+  model_->setTargetCounts(dict_->getCounts(entry_type::label));
+  prepare();
+}
+
+void Trainer::test(
+    const Corpus& corpus,
+    int32_t k,
+    real threshold,
+    Meter& meter) const {
+  std::vector<int32_t> line, labels, hashes;
+  std::vector<std::pair<real, int32_t>> predictions;
+  for (size_t i = 0; i < corpus.size(); i++) {
+    corpus.get(i, line, labels, hashes);
+    addWordNgrams(line, hashes);
+    if (!labels.empty() && !line.empty()) {
+      predict(k, line, predictions, threshold);
+      meter.log(labels, predictions);
+    }
+  }
+}
+
+real Trainer::getLoss() const {
+  return trainLoss_;
+}
+
+} // namespace fasttext
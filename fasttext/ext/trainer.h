@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <istream>
+
+#include "args.h"
+#include "corpus.h"
+#include "meter.h"
+#include "predictor.h"
+
+namespace fasttext {
+
+// Trains supervised models from data that is not in a file: the dictionary is
+// read from any stream and the examples are tokenized beforehand into a Corpus
+// (with Predictor::getWords once the dictionary is ready, the word n-grams are
+// added while training), so several trainings can share it. After training
+// the model can predict and be saved as if it had been loaded.
+class Trainer : public Predictor {
+ protected:
+  real trainLoss_;
+
+  real trainThread(
+      const Corpus& corpus,
+      int32_t threadId,
+      std::atomic<int64_t>& tokenCount);
+
+ public:
+  explicit Trainer(const Args& args);
+  // Shares the dictionary read by 'other', its corpus can be used. Only
+  // 'minCount', 'minCountLabel', 'label', 'minn', 'maxn' and (if there are
+  // character n-grams) 'bucket' have to be the same in both. Throws
+  // std::logic_error if 'other' has not read its dictionary yet.
+  Trainer(const Args& args, const Trainer& other);
+
+  // Counts words and labels of the text (fastText format, one example per
+  // line) to build the dictionary, the model is not trained yet
+  void readDictionary(std::istream& in);
+  // Trains with 'args.thread' threads, the dictionary must be ready
+  void train(const Corpus& corpus);
+
+  // Same as FastText::test with the examples of the corpus
+  void test(const Corpus& corpus, int32_t k, real threshold, Meter& meter)
+      const;
+
+  // Average loss of the examples seen by the last call to train
+  real getLoss() const;
+};
+
+} // namespace fasttext
@@ -1,10 +1,13 @@
 #include <iostream>
 #include <fasttext/fasttext.h>
+#include <fasttext/predictor.h>
 
 int main(void)
 {
     std::cout << "Fasttext test_package\n";
     fasttext::FastText model{};
     std::cout << "FastText::isQuant() = " << model.isQuant() << "\n";
+    fasttext::Predictor predictor{};
+    std::cout << "Predictor::specializedDim() = " << predictor.specializedDim() << "\n";
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,204 @@
+/**
+ * Reports what is lost and gained keeping the matrices of a model as float16
+ * or int8 instead of float32: memory, throughput and, for supervised models,
+ * precision/recall on a test file and how many predictions change (for the
+ * other models, how much the word vectors move).
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "predictor.h"
+
+using namespace fasttext;
+
+namespace {
+
+typedef std::vector<std::pair<real, int32_t>> Predictions;
+
+const size_t maxWords = 10000;
+
+double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+struct Report {
+  std::string storage;
+  size_t memory;
+  double load;
+  double throughput;
+  double precision;
+  double recall;
+  double agreement; // fraction of top predictions equal to the float32 ones
+  double drift; // mean absolute change of the probabilities or the cosine
+};
+
+void printUsage() {
+  std::cerr
+      << "usage: fasttext-compact <model> [<test-data>] [<k>]\n\n"
+      << "  <model>      model filename (.bin)\n"
+      << "  <test-data>  labeled data to compare supervised models with\n"
+      << "  <k>          (optional; 1 by default) predict top k labels\n"
+      << std::endl;
+}
+
+void readTests(
+    const Predictor& predictor,
+    const std::string& filename,
+    std::vector<std::vector<int32_t>>& lines,
+    std::vector<std::vector<int32_t>>& labels) {
+  std::ifstream ifs(filename);
+  if (!ifs.is_open()) {
+    std::cerr << "Test file cannot be opened!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::vector<int32_t> line, label;
+  while (ifs.peek() != EOF) {
+    predictor.getDictionary()->getLine(ifs, line, label);
+    if (!line.empty()) {
+      lines.push_back(line);
+      labels.push_back(label);
+    }
+  }
+}
+
+Report supervised(
+    const Predictor& predictor,
+    const std::vector<std::vector<int32_t>>& lines,
+    const std::vector<std::vector<int32_t>>& labels,
+    int32_t k,
+    std::vector<Predictions>& reference) {
+  Report report = Report();
+  std::vector<Predictions> results(lines.size());
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lines.size(); i++) {
+    predictor.predict(k, lines[i], results[i]);
+  }
+  report.throughput = lines.size() / seconds(start);
+
+  Meter meter;
+  size_t agree = 0, compared = 0;
+  double drift = 0.0;
+  for (size_t i = 0; i < lines.size(); i++) {
+    meter.log(labels[i], results[i]);
+    if (reference.size() < lines.size() || results[i].empty() ||
+        reference[i].empty()) {
+      continue;
+    }
+    compared++;
+    if (results[i][0].second == reference[i][0].second) {
+      agree++;
+    }
+    drift += std::abs(results[i][0].first - reference[i][0].first);
+  }
+  report.precision = meter.precision();
+  report.recall = meter.recall();
+  report.agreement = compared ? double(agree) / compared : 1.0;
+  report.drift = compared ? drift / compared : 0.0;
+  if (reference.size() < lines.size()) {
+    reference.swap(results);
+  }
+  return report;
+}
+
+Report unsupervised(const Predictor& predictor, std::vector<Vector>& reference) {
+  Report report = Report();
+  const int64_t dim = predictor.getArgs().dim;
+  auto dict = predictor.getDictionary();
+  const size_t nwords = std::min<size_t>(dict->nwords(), maxWords);
+
+  std::vector<Vector> vectors;
+  vectors.reserve(nwords);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < nwords; i++) {
+    vectors.emplace_back(dim);
+    predictor.getWordVector(vectors.back(), dict->getWord(i));
+  }
+  report.throughput = nwords / seconds(start);
+
+  double drift = 0.0;
+  if (reference.size() == nwords) {
+    for (size_t i = 0; i < nwords; i++) {
+      real dot = 0.0;
+      for (int64_t j = 0; j < dim; j++) {
+        dot += vectors[i][j] * reference[i][j];
+      }
+      const real norms = vectors[i].norm() * reference[i].norm();
+      drift += norms > 0 ? 1.0 - dot / norms : 0.0;
+    }
+    report.drift = nwords ? drift / nwords : 0.0;
+  } else {
+    reference.swap(vectors);
+  }
+  report.precision = report.recall = report.agreement = 1.0;
+  return report;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 4) {
+    printUsage();
+    exit(EXIT_FAILURE);
+  }
+  const std::string model(argv[1]);
+  const std::string test = argc > 2 ? argv[2] : "";
+  const int32_t k = argc > 3 ? std::atoi(argv[3]) : 1;
+
+  std::vector<std::vector<int32_t>> lines, labels;
+  std::vector<Predictions> predictions;
+  std::vector<Vector> vectors;
+  std::vector<Report> reports;
+  bool isSupervised = false;
+
+  for (storage mode : {storage::f32, storage::f16, storage::i8}) {
+    Predictor predictor;
+    auto start = std::chrono::steady_clock::now();
+    predictor.loadModel(model, mode);
+    const double load = seconds(start);
+
+    isSupervised = predictor.getArgs().model == model_name::sup;
+    if (isSupervised && test.empty()) {
+      std::cerr << "Supervised models need test data" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (isSupervised && lines.empty()) {
+      readTests(predictor, test, lines, labels);
+    }
+
+    Report report = isSupervised
+        ? supervised(predictor, lines, labels, k, predictions)
+        : unsupervised(predictor, vectors);
+    report.storage = storageName(mode);
+    report.memory = predictor.memory();
+    report.load = load;
+    reports.push_back(report);
+  }
+
+  std::cout << std::fixed << std::setprecision(4);
+  std::cout << "storage\tmemory (MB)\tload (s)\t"
+            << (isSupervised ? "predictions/s\tP@" + std::to_string(k) +
+                        "\tR@" + std::to_string(k) +
+                        "\tagreement\tprobability drift"
+                             : "words/s\tcosine drift")
+            << std::endl;
+  for (const Report& report : reports) {
+    std::cout << report.storage << "\t" << report.memory / (1024.0 * 1024.0)
+              << "\t" << report.load << "\t" << report.throughput;
+    if (isSupervised) {
+      std::cout << "\t" << report.precision << "\t" << report.recall << "\t"
+                << report.agreement;
+    }
+    std::cout << "\t" << report.drift << std::endl;
+  }
+  return 0;
+}
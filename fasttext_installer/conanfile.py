@@ -14,7 +14,7 @@ class FastText(ConanFile):
     settings = "os", "arch", "build_type"
     generators = "cmake"
 
-    exports_sources = "CMakeLists.txt"
+    exports_sources = "CMakeLists.txt", "compact.cc", "tune.cc"
 
     def requirements(self):
         self.requires("fasttext/{}@{}/{}".format(self.version, self.user, self.channel))
@@ -0,0 +1,495 @@
+/**
+ * Searches the learning rate, dimension, word n-grams, buckets and epochs of a
+ * supervised model for the best precision/recall on a validation file. Both
+ * files are read and tokenized once, then several trials train at the same
+ * time from the same examples: random configurations are tried with the
+ * fewest epochs, and the best third of each round is trained again with more
+ * (asynchronous successive halving) until the time is over. The best model
+ * found is kept as '<output>.bin'. Trials only start while the matrices of the
+ * ones running fit in the memory budget.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "trainer.h"
+
+using namespace fasttext;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const double minLr = 0.05, maxLr = 2.0;
+const int dims[] = {10, 25, 50, 100, 200, 300};
+const int wordNgrams[] = {1, 2, 3};
+const int buckets[] = {200000, 1000000, 2000000};
+
+double seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Options {
+  std::string train;
+  std::string validation;
+  std::string output;
+  double duration = 300;
+  int jobs = 0;
+  double memory = 0;
+  int trials = 0;
+  int maxEpoch = 50;
+  int eta = 3;
+  int k = 1;
+  unsigned seed = 0;
+  std::vector<std::string> fasttext;
+};
+
+struct Config {
+  double lr;
+  int dim;
+  int wordNgrams;
+  int bucket;
+};
+
+struct Result {
+  size_t config;
+  double score;
+  bool promoted;
+};
+
+struct Trial {
+  size_t config;
+  size_t rung;
+};
+
+void printUsage() {
+  std::cerr
+      << "usage: fasttext-tune <train> <validation> <output> [options] "
+      << "[fastText supervised options]\n\n"
+      << "  <train>       training file path\n"
+      << "  <validation>  labeled data to rank the models with\n"
+      << "  <output>      the best model is saved as '<output>.bin'\n"
+      << "  -duration     seconds to start new trials for [300]\n"
+      << "  -jobs         trials trained at the same time "
+      << "[cores / -thread]\n"
+      << "  -memory       MB for the matrices of the trials trained at the "
+      << "same time [half of the RAM]\n"
+      << "  -trials       configurations tried, 0 for as many as time "
+      << "allows [0]\n"
+      << "  -maxEpoch     epochs of the last round [50]\n"
+      << "  -eta          one in 'eta' trials of a round goes to the next, "
+      << "with 'eta' times the epochs [3]\n"
+      << "  -k            predict top k labels to compute precision/recall [1]\n"
+      << "  -seed         seed of the random search [0]\n\n"
+      << "Each trial uses -thread threads, the other fastText options are "
+      << "the same for all of them.\n"
+      << std::endl;
+}
+
+Options parseOptions(int argc, char** argv) {
+  if (argc < 4) {
+    printUsage();
+    exit(EXIT_FAILURE);
+  }
+  Options options;
+  options.train = argv[1];
+  options.validation = argv[2];
+  options.output = argv[3];
+  for (int i = 4; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (i + 1 == argc) {
+      options.fasttext.push_back(arg);
+    } else if (arg == "-duration") {
+      options.duration = std::atof(argv[++i]);
+    } else if (arg == "-jobs") {
+      options.jobs = std::atoi(argv[++i]);
+    } else if (arg == "-memory") {
+      options.memory = std::atof(argv[++i]);
+    } else if (arg == "-trials") {
+      options.trials = std::atoi(argv[++i]);
+    } else if (arg == "-maxEpoch") {
+      options.maxEpoch = std::atoi(argv[++i]);
+    } else if (arg == "-eta") {
+      options.eta = std::atoi(argv[++i]);
+    } else if (arg == "-k") {
+      options.k = std::atoi(argv[++i]);
+    } else if (arg == "-seed") {
+      options.seed = std::atoi(argv[++i]);
+    } else {
+      options.fasttext.push_back(arg);
+    }
+  }
+  if (options.maxEpoch < 1 || options.eta < 2 || options.k < 1) {
+    printUsage();
+    exit(EXIT_FAILURE);
+  }
+  return options;
+}
+
+// Bytes of half of the physical memory
+double defaultMemory() {
+  const long pages = sysconf(_SC_PHYS_PAGES), size = sysconf(_SC_PAGE_SIZE);
+  return pages > 0 && size > 0 ? double(pages) * size / 2 : 4e9;
+}
+
+std::string readFile(const std::string& filename) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs.is_open()) {
+    std::cerr << filename << " cannot be opened!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return std::string(
+      std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+// Tokenizes the lines of the text with 'threads' threads, each one a part of
+// it, and keeps them in order
+Corpus tokenize(const Predictor& predictor, const std::string& text, int threads) {
+  std::vector<const char*> bounds{text.data()};
+  const char* end = text.data() + text.size();
+  for (int i = 1; i < threads; i++) {
+    const char* p = std::max(
+        bounds.back(), text.data() + text.size() * i / threads);
+    while (p != end && *p++ != '\n') {
+    }
+    bounds.push_back(p);
+  }
+  bounds.push_back(end);
+
+  std::vector<Corpus> parts(threads);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.push_back(std::thread([&, i]() {
+      std::vector<int32_t> words, labels, hashes;
+      int32_t ntokens;
+      const char* p = bounds[i];
+      while (p != bounds[i + 1]) {
+        p = predictor.getWords(
+            p, bounds[i + 1], words, labels, hashes, &ntokens);
+        parts[i].add(words, labels, hashes, ntokens);
+      }
+    }));
+  }
+  Corpus ret;
+  for (int i = 0; i < threads; i++) {
+    workers[i].join();
+    ret.append(parts[i]);
+  }
+  return ret;
+}
+
+// Epochs of each round, fewest first: 'maxEpoch' divided by 'eta' until it
+// reaches one
+std::vector<int> rounds(int maxEpoch, int eta) {
+  std::vector<int> ret;
+  for (int epoch = maxEpoch; epoch >= 1; epoch /= eta) {
+    ret.insert(ret.begin(), epoch);
+  }
+  return ret;
+}
+
+class Search {
+ public:
+  Search(
+      const Options& options,
+      const Args& args,
+      std::shared_ptr<const Dictionary> dict)
+      : options_(options),
+        args_(args),
+        nwords_(dict->nwords()),
+        nlabels_(dict->nlabels()),
+        budget_(
+            options.memory > 0 ? options.memory * 1024 * 1024
+                               : defaultMemory()),
+        epochs_(rounds(options.maxEpoch, options.eta)),
+        results_(epochs_.size()),
+        rng_(options.seed),
+        deadline_(
+            Clock::now() +
+            std::chrono::milliseconds(int64_t(options.duration * 1000))),
+        running_(0),
+        used_(0),
+        best_(-1.0),
+        saved_(-1.0) {}
+
+  void run(const Trainer& base, const Corpus& train, const Corpus& validation) {
+    const int jobs = options_.jobs > 0
+        ? options_.jobs
+        : std::max<int>(
+              1, std::thread::hardware_concurrency() / args_.thread);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs; i++) {
+      workers.push_back(
+          std::thread([&]() { work(base, train, validation); }));
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  bool found() const {
+    return best_ >= 0;
+  }
+
+  Args bestArgs() const {
+    return makeArgs(configs_[bestTrial_.config], epochs_[bestTrial_.rung]);
+  }
+
+  double bestScore() const {
+    return best_;
+  }
+
+  size_t trials() const {
+    return configs_.size();
+  }
+
+ protected:
+  const Options& options_;
+  const Args args_;
+  const int64_t nwords_;
+  const int64_t nlabels_;
+  const double budget_;
+  const std::vector<int> epochs_;
+  std::vector<Config> configs_;
+  std::vector<std::vector<Result>> results_;
+  std::minstd_rand rng_;
+  const Clock::time_point deadline_;
+
+  std::mutex mutex_;
+  std::condition_variable done_;
+  int running_;
+  // bytes of the matrices of the running trials
+  double used_;
+  double best_;
+  Trial bestTrial_;
+  // the model is saved outside of 'mutex_', another trial may be better
+  // meanwhile
+  std::mutex saving_;
+  double saved_;
+
+  // Bytes of the input and output matrices of a model
+  double memory(const Config& config) const {
+    return double(nwords_ + config.bucket + nlabels_) * config.dim *
+        sizeof(real);
+  }
+
+  // Configurations that don't fit in the budget are drawn again (a few times,
+  // then the last one is trained alone)
+  Config randomConfig() {
+    Config config;
+    for (int i = 0; i < 100; i++) {
+      config = drawConfig();
+      if (memory(config) <= budget_) {
+        break;
+      }
+    }
+    return config;
+  }
+
+  Config drawConfig() {
+    std::uniform_real_distribution<> uniform(std::log(minLr), std::log(maxLr));
+    Config config;
+    config.lr = std::exp(uniform(rng_));
+    config.dim = dims[rng_() % (sizeof(dims) / sizeof(dims[0]))];
+    config.wordNgrams =
+        wordNgrams[rng_() % (sizeof(wordNgrams) / sizeof(wordNgrams[0]))];
+    // the buckets of the character n-grams have to match the dictionary
+    config.bucket = args_.maxn > 0
+        ? args_.bucket
+        : buckets[rng_() % (sizeof(buckets) / sizeof(buckets[0]))];
+    if (config.wordNgrams <= 1 && args_.maxn == 0) {
+      config.bucket = 0;
+    }
+    return config;
+  }
+
+  Args makeArgs(const Config& config, int epoch) const {
+    Args args = args_;
+    args.lr = config.lr;
+    args.dim = config.dim;
+    args.wordNgrams = config.wordNgrams;
+    args.bucket = config.bucket;
+    args.epoch = epoch;
+    return args;
+  }
+
+  // Under 'mutex_': the next trial, either one of the best of a round that
+  // is not in the next one yet (the latest rounds first) or a new
+  // configuration in the first round
+  bool next(Trial& trial) {
+    for (size_t rung = epochs_.size() - 1; rung-- > 0;) {
+      std::vector<Result>& results = results_[rung];
+      std::sort(
+          results.begin(),
+          results.end(),
+          [](const Result& a, const Result& b) { return a.score > b.score; });
+      for (size_t i = 0; i < results.size() / options_.eta; i++) {
+        if (!results[i].promoted) {
+          results[i].promoted = true;
+          trial = Trial{results[i].config, rung + 1};
+          return true;
+        }
+      }
+    }
+    if (options_.trials > 0 && int(configs_.size()) >= options_.trials) {
+      return false;
+    }
+    configs_.push_back(randomConfig());
+    trial = Trial{configs_.size() - 1, 0};
+    return true;
+  }
+
+  void work(const Trainer& base, const Corpus& train, const Corpus& validation) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (Clock::now() < deadline_) {
+      Trial trial;
+      if (!next(trial)) {
+        // the running trials may still be promoted
+        if (running_ == 0) {
+          break;
+        }
+        done_.wait_until(lock, deadline_);
+        continue;
+      }
+      const Args args = makeArgs(configs_[trial.config], epochs_[trial.rung]);
+      // wait for the memory, unless nothing else is running
+      const double needed = memory(configs_[trial.config]);
+      while (used_ > 0 && used_ + needed > budget_ &&
+             Clock::now() < deadline_) {
+        done_.wait_until(lock, deadline_);
+      }
+      if (used_ > 0 && used_ + needed > budget_) {
+        break;
+      }
+      used_ += needed;
+      running_++;
+      lock.unlock();
+
+      const Clock::time_point start = Clock::now();
+      Trainer trainer(args, base);
+      trainer.train(train);
+      Meter meter;
+      trainer.test(validation, options_.k, 0.0, meter);
+      const double precision = meter.precision(), recall = meter.recall();
+      const double score = precision + recall > 0
+          ? 2 * precision * recall / (precision + recall)
+          : 0.0;
+      const double elapsed = seconds(start);
+
+      lock.lock();
+      running_--;
+      results_[trial.rung].push_back(Result{trial.config, score, false});
+      const bool best = score > best_;
+      if (best) {
+        best_ = score;
+        bestTrial_ = trial;
+      }
+      std::cout << std::fixed << std::setprecision(4) << "trial "
+                << trial.config << "\tepoch " << args.epoch << "\tlr "
+                << args.lr << "\tdim " << args.dim << "\twordNgrams "
+                << args.wordNgrams << "\tbucket " << args.bucket << "\tP@"
+                << options_.k << " " << precision << "\tR@" << options_.k
+                << " " << recall << "\t" << std::setprecision(1) << elapsed
+                << "s" << (best ? "\tbest" : "") << std::endl;
+      done_.notify_all();
+      if (best) {
+        lock.unlock();
+        save(trainer, score);
+        lock.lock();
+      }
+      used_ -= needed;
+      done_.notify_all();
+    }
+    done_.notify_all();
+  }
+
+  void save(Trainer& trainer, double score) {
+    std::lock_guard<std::mutex> lock(saving_);
+    if (score <= saved_) {
+      return;
+    }
+    // a model that is being written is never left as the output
+    const std::string filename = options_.output + ".bin";
+    trainer.saveModel(filename + ".tmp");
+    if (std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+      std::cerr << filename << " cannot be written!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    saved_ = score;
+  }
+};
+
+std::string commandLine(const Args& args) {
+  std::ostringstream ret;
+  ret << "-lr " << args.lr << " -dim " << args.dim << " -wordNgrams "
+      << args.wordNgrams << " -bucket " << args.bucket << " -epoch "
+      << args.epoch;
+  return ret.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+  std::vector<std::string> arguments{"fasttext-tune",
+                                     "supervised",
+                                     "-input",
+                                     options.train,
+                                     "-output",
+                                     options.output};
+  arguments.insert(
+      arguments.end(), options.fasttext.begin(), options.fasttext.end());
+  Args args;
+  args.parseArgs(arguments);
+
+  const Clock::time_point start = Clock::now();
+  Trainer base(args);
+  {
+    std::ifstream ifs(options.train);
+    if (!ifs.is_open()) {
+      std::cerr << "Input file cannot be opened!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    base.readDictionary(ifs);
+  }
+  const int threads = std::max(1u, std::thread::hardware_concurrency());
+  const Corpus train = tokenize(base, readFile(options.train), threads);
+  const Corpus validation =
+      tokenize(base, readFile(options.validation), threads);
+  if (train.ntokens() == 0) {
+    std::cerr << "Nothing to train with" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cerr << "Read " << train.size() << " training and "
+            << validation.size() << " validation examples in "
+            << std::setprecision(1) << std::fixed << seconds(start) << "s"
+            << std::endl;
+
+  Search search(options, args, base.getDictionary());
+  search.run(base, train, validation);
+  if (!search.found()) {
+    std::cerr << "No trial finished" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cout << std::setprecision(4) << "trials: " << search.trials()
+            << ", best F1@" << options.k << ": " << search.bestScore()
+            << ", model: " << options.output << ".bin\n"
+            << commandLine(search.bestArgs()) << std::endl;
+  return 0;
+}